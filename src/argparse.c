@@ -65,6 +65,9 @@ parsed_args_t pargs = {
     /* gc                  */ 0,
 #ifdef NATIVE
     /* kernel              */ 0,
+    /* resolve             */ 0,
+    /* frame_pointers      */ 0,
+    /* per_thread          */ 0,
 #endif
 };
 
@@ -233,6 +236,18 @@ static struct argp_option options[] = {
     "kernel",       'k', NULL,          0,
     "Sample the kernel call stack."
   },
+  {
+    "resolve",      'r', NULL,          0,
+    "Resolve native frames to module and offset while sampling."
+  },
+  {
+    "frame-pointers", 'F', NULL,        0,
+    "Unwind native stacks by following frame pointers, where possible."
+  },
+  {
+    "per-thread",   'T', NULL,          0,
+    "Stop one thread at a time while sampling, rather than the whole process."
+  },
   #endif
   #ifndef GNU_ARGP
   {
@@ -332,6 +347,18 @@ parse_opt(int key, char* arg, struct argp_state* state) {
     case 'k':
         pargs.kernel = true;
         break;
+
+    case 'r':
+        pargs.resolve = true;
+        break;
+
+    case 'F':
+        pargs.frame_pointers = true;
+        break;
+
+    case 'T':
+        pargs.per_thread = true;
+        break;
 #endif
 
     case ARGP_KEY_ARG:
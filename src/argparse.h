@@ -53,6 +53,9 @@ typedef struct {
     bool           gc;
 #ifdef NATIVE
     bool kernel;
+    bool resolve;
+    bool frame_pointers;
+    bool per_thread;
 #endif
 } parsed_args_t;
 
@@ -405,6 +405,13 @@ main(int argc, char** argv) {
         pargs.cpu = false;
     }
 
+#if defined NATIVE && !defined __x86_64__
+    if (pargs.frame_pointers) {
+        log_w("Frame pointer unwinding is only supported on x86-64. Native stacks will be unwound with libunwind.");
+        pargs.frame_pointers = false;
+    }
+#endif
+
     // Register signal handler for Ctrl+C and terminate signals.
     signal(SIGINT, signal_callback_handler);
     signal(SIGTERM, signal_callback_handler);
@@ -77,10 +77,12 @@ mojo_event_handler__handle_new_string(base_event_handler_t* self, cached_string_
 
 static inline void
 mojo_event_handler__handle_new_frame(base_event_handler_t* self, frame_t* frame) {
+    key_dt scope_key = frame->scope == UNKNOWN_SCOPE ? (key_dt)(uintptr_t)UNKNOWN_SCOPE : frame->scope->key;
+
     mojo_event(MOJO_FRAME);
     mojo_integer(frame->key, 0);
     mojo_ref(frame->filename->key);
-    mojo_ref(frame->scope->key);
+    mojo_ref(scope_key);
     mojo_integer(frame->line, 0);
     mojo_integer(frame->line_end, 0);
     mojo_integer(frame->column, 0);
@@ -130,9 +132,8 @@ mojo_event_handler__handle_stack_end(base_event_handler_t* self) {
     }
 #endif
     while (!stack_kernel_is_empty()) {
-        char* scope = stack_kernel_pop();
-        mojo_frame_kernel(scope);
-        free(scope);
+        cached_string_t* scope = stack_kernel_pop();
+        mojo_string_ref(scope->key);
     }
 
 #else
@@ -183,6 +184,11 @@ mojo_event_handler_new(void) {
 
     mojo_header();
 
+#ifdef NATIVE
+    // Native frames might refer to the unknown scope sentinel.
+    mojo_string_event(UNKNOWN_SCOPE, "<unknown>");
+#endif
+
     return handler;
 }
 
@@ -274,9 +280,8 @@ where_event_handler__handle_stack_end(base_event_handler_t* self) {
     }
 #endif
     while (!stack_kernel_is_empty()) {
-        char* scope = stack_kernel_pop();
-        format_kernel_frame_ref(WHERE_SAMPLE_FORMAT_KERNEL, scope);
-        free(scope);
+        cached_string_t* scope = stack_kernel_pop();
+        format_kernel_frame_ref(WHERE_SAMPLE_FORMAT_KERNEL, scope->value);
     }
 
 #else
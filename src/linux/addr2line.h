@@ -23,6 +23,8 @@
 // This source has been adapted from
 // https://github.com/bminor/binutils-gdb/blob/ce230579c65b9e04c830f35cb78ff33206e65db1/binutils/addr2line.c
 
+#pragma once
+
 #define PACKAGE "austinp" // https://github.com/P403n1x87/austin/issues/152
 
 #include <bfd.h>
@@ -34,14 +36,14 @@
 #include <libiberty/demangle.h>
 #endif
 
+#include "../cache.h"
 #include "../hints.h"
 #include "../logging.h"
 #include "../py_string.h"
 #include "../stack.h"
+#include "elf-file.h"
 
-static asymbol** syms; /* Symbol table.  */
-
-static void
+static asymbol**
 slurp_symtab(bfd*);
 static void
 find_address_in_section(bfd*, asection*, void*);
@@ -89,14 +91,15 @@ demangle_cython(char* function) {
 
 /* Read in the symbol table.  */
 
-static void
+static asymbol**
 slurp_symtab(bfd* abfd) {
-    long storage;
-    long symcount;
-    bool dynamic = false;
+    asymbol** syms;
+    long      storage;
+    long      symcount;
+    bool      dynamic = false;
 
     if ((bfd_get_file_flags(abfd) & HAS_SYMS) == 0) // GCOV_EXCL_LINE
-        return;                                     // GCOV_EXCL_LINE
+        return NULL;                                // GCOV_EXCL_LINE
 
     storage = bfd_get_symtab_upper_bound(abfd);
     if (storage == 0) { // GCOV_EXCL_START
@@ -104,15 +107,19 @@ slurp_symtab(bfd* abfd) {
         dynamic = true;
     } // GCOV_EXCL_STOP
     if (storage < 0) // GCOV_EXCL_LINE
-        return;      // GCOV_EXCL_LINE
+        return NULL; // GCOV_EXCL_LINE
 
     syms = (asymbol**)malloc(storage);
+    if (!isvalid(syms)) // GCOV_EXCL_LINE
+        return NULL;    // GCOV_EXCL_LINE
     if (dynamic)
         symcount = bfd_canonicalize_dynamic_symtab(abfd, syms);
     else
         symcount = bfd_canonicalize_symtab(abfd, syms);
-    if (symcount < 0) // GCOV_EXCL_LINE
-        return;       // GCOV_EXCL_LINE
+    if (symcount < 0) { // GCOV_EXCL_START
+        free(syms);
+        return NULL;
+    } // GCOV_EXCL_STOP
 
     /* If there are no symbols left after canonicalization and
      we have not tried the dynamic symbols then give them a go.  */
@@ -128,19 +135,27 @@ slurp_symtab(bfd* abfd) {
         free(syms);
         syms = NULL;
     } // GCOV_EXCL_STOP
+
+    return syms;
 }
 
-static bfd_vma      pc;
-static const char*  filename;
-static const char*  functionname;
-static unsigned int line;
-static unsigned int discriminator;
+// The state of a single source location lookup. It is passed down to
+// find_address_in_section so that lookups need no global state.
+typedef struct {
+    asymbol**    syms;
+    bfd_vma      pc;
+    const char*  filename;
+    const char*  functionname;
+    unsigned int line;
+    unsigned int discriminator;
+} bfd_lookup_t;
 
 /* Look for an address in a section.  This is called via
    bfd_map_over_sections.  */
 
 static void
-find_address_in_section(bfd* abfd, asection* section, void* data ATTRIBUTE_UNUSED) {
+find_address_in_section(bfd* abfd, asection* section, void* data) {
+    bfd_lookup_t* lookup = (bfd_lookup_t*)data;
     bfd_vma       vma;
     bfd_size_type size;
 
@@ -148,74 +163,246 @@ find_address_in_section(bfd* abfd, asection* section, void* data ATTRIBUTE_UNUSE
         return;
 
     vma = bfd_section_vma(section);
-    if (pc < vma)
+    if (lookup->pc < vma)
         return;
 
     size = bfd_section_size(section);
-    if (pc >= vma + size)
+    if (lookup->pc >= vma + size)
         return;
 
-    bfd_find_nearest_line_discriminator(abfd, section, syms, pc - vma, &filename, &functionname, &line, &discriminator);
+    bfd_find_nearest_line_discriminator(
+        abfd, section, lookup->syms, lookup->pc - vma, &lookup->filename, &lookup->functionname, &lookup->line,
+        &lookup->discriminator
+    );
 }
 
-static inline frame_t*
-get_native_frame(const char* file_name, bfd_vma addr, key_dt frame_key) {
-    bfd*   abfd;
+// ----------------------------------------------------------------------------
+// BFD objects are expensive to create, so we keep one per binary, together
+// with its symbol table. The file content is read from the shared ELF mapping
+// rather than by BFD itself. Binaries that cannot be opened are kept too, with
+// no BFD object, so that we do not try to open them again.
+typedef struct _bfd_file {
+    char*       path;
+    elf_file_t* elf;
+    bfd*        abfd;
+    asymbol**   syms;
+
+    struct _bfd_file* next; // Next binary with the same path hash
+} bfd_file_t;
+
+static lookup_t* _bfd_files = NULL;
+
+static void*
+_bfd_file__open(struct bfd* abfd ATTRIBUTE_UNUSED, void* elf) {
+    return elf;
+}
+
+static file_ptr
+_bfd_file__pread(struct bfd* abfd ATTRIBUTE_UNUSED, void* stream, void* buf, file_ptr nbytes, file_ptr offset) {
+    elf_file_t* elf = (elf_file_t*)stream;
+
+    if (offset < 0 || (size_t)offset >= elf_file__size(elf))
+        return 0;
+    if ((size_t)(offset + nbytes) > elf_file__size(elf))
+        nbytes = elf_file__size(elf) - offset;
+
+    memcpy(buf, elf_file__data(elf, offset), nbytes);
+
+    return nbytes;
+}
+
+static int
+_bfd_file__close(struct bfd* abfd ATTRIBUTE_UNUSED, void* stream ATTRIBUTE_UNUSED) {
+    // The ELF mapping is released by the owning bfd_file_t object.
+    return 0;
+}
+
+static int
+_bfd_file__stat(struct bfd* abfd ATTRIBUTE_UNUSED, void* stream, struct stat* sb) {
+    memset(sb, 0, sizeof(struct stat));
+    sb->st_size = elf_file__size((elf_file_t*)stream);
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+static inline void
+bfd_file__destroy(bfd_file_t* self) {
+    if (!isvalid(self))
+        return;
+
+    if (isvalid(self->abfd))
+        bfd_close(self->abfd);
+    sfree(self->syms);
+    elf_file__close(self->elf);
+    sfree(self->path);
+
+    free(self);
+}
+
+// ----------------------------------------------------------------------------
+static inline bfd_file_t*
+bfd_file_new(const char* file_name) {
     char** matching;
 
-    // TODO: This would be much cheaper if we could read directly from memory.
-    abfd = bfd_openr(file_name, NULL);
-    if (abfd == NULL) { // GCOV_EXCL_START
-        log_e("Failed to open %s", file_name);
+    bfd_file_t* self = (bfd_file_t*)calloc(1, sizeof(bfd_file_t));
+    if (!isvalid(self)) { // GCOV_EXCL_START
+        set_error(MALLOC, "Cannot allocate memory for BFD file");
         FAIL_PTR;
     } // GCOV_EXCL_STOP
 
+    self->elf = elf_file_open((char*)file_name);
+    if (!isvalid(self->elf)) { // GCOV_EXCL_START
+        log_e("Failed to open %s", file_name);
+        goto error;
+    } // GCOV_EXCL_STOP
+
+    self->abfd = bfd_openr_iovec(
+        file_name, NULL, _bfd_file__open, self->elf, _bfd_file__pread, _bfd_file__close, _bfd_file__stat
+    );
+    if (!isvalid(self->abfd)) { // GCOV_EXCL_START
+        log_e("Failed to open %s", file_name);
+        goto error;
+    } // GCOV_EXCL_STOP
+
     /* Decompress sections.  */
-    abfd->flags |= BFD_DECOMPRESS;
+    self->abfd->flags |= BFD_DECOMPRESS;
 
-    if (bfd_check_format(abfd, bfd_archive)) { // GCOV_EXCL_START
+    if (bfd_check_format(self->abfd, bfd_archive)) { // GCOV_EXCL_START
         log_e("BFD format check failed");
-        FAIL_PTR;
+        goto error;
     } // GCOV_EXCL_STOP
 
-    if (!bfd_check_format_matches(abfd, bfd_object, &matching)) { // GCOV_EXCL_START
+    if (!bfd_check_format_matches(self->abfd, bfd_object, &matching)) { // GCOV_EXCL_START
         free(matching);
         log_d("BFD format matches check failed.");
-        FAIL_PTR;
+        goto error;
     } // GCOV_EXCL_STOP
 
-    slurp_symtab(abfd);
+    self->syms = slurp_symtab(self->abfd);
 
-    // Reset global state for a new lookup
-    filename = functionname = NULL;
-    line = discriminator = 0;
-    pc                   = addr;
+    return self;
 
-    bfd_map_over_sections(abfd, find_address_in_section, NULL);
+error: // GCOV_EXCL_START
+    bfd_file__destroy(self);
+    FAIL_PTR;
+} // GCOV_EXCL_STOP
 
-    const char* name;
+// ----------------------------------------------------------------------------
+static inline bfd_file_t*
+_bfd_file__get(const char* file_name) {
+    if (!isvalid(_bfd_files)) {
+        _bfd_files = lookup_new(16);
+        if (!isvalid(_bfd_files)) // GCOV_EXCL_LINE
+            FAIL_PTR;             // GCOV_EXCL_LINE
+    }
 
-    name = functionname;
-    if (name == NULL || *name == '\0')
-        name = "<unnamed>";
-#ifdef HAVE_LIBERTY
-    else {
-        char* alloc = bfd_demangle(abfd, name, DMGL_PARAMS | DMGL_ANSI);
-        if (alloc != NULL)
-            name = alloc;
+    key_dt      key  = string__hash((char*)file_name);
+    bfd_file_t* head = (bfd_file_t*)lookup__get(_bfd_files, key);
+    bfd_file_t* file = head;
+    while (isvalid(file) && strcmp(file->path, file_name) != 0)
+        file = file->next;
+
+    if (!isvalid(file)) {
+        file = bfd_file_new(file_name);
+        if (!isvalid(file)) {
+            file = (bfd_file_t*)calloc(1, sizeof(bfd_file_t));
+            if (!isvalid(file)) // GCOV_EXCL_LINE
+                FAIL_PTR;       // GCOV_EXCL_LINE
+        }
+
+        file->path = strdup(file_name);
+        if (!isvalid(file->path)) { // GCOV_EXCL_START
+            bfd_file__destroy(file);
+            FAIL_PTR;
+        } // GCOV_EXCL_STOP
+
+        // Binaries are never replaced, as the frames resolved in where mode
+        // borrow their source file names from BFD.
+        file->next = head;
+        lookup__set(_bfd_files, key, file);
     }
+
+    if (!isvalid(file->abfd))
+        FAIL_PTR;
+
+    return file;
+}
+
+// ----------------------------------------------------------------------------
+/**
+ * Resolve an address within a binary to its source location.
+ *
+ * @param file_name  the path of the binary
+ * @param addr       the address, relative to the load address of the binary
+ * @param source     set to the source file name, owned by BFD
+ * @param name       set to a new string with the (demangled) function name
+ * @param lineno     set to the line number
+ *
+ * @return 0 if the source location could be determined, 1 otherwise.
+ */
+static inline int
+resolve_native_location(
+    const char* file_name, bfd_vma addr, const char** source, char** name, unsigned int* lineno
+) {
+    bfd_file_t* file = _bfd_file__get(file_name);
+    if (!isvalid(file))
+        FAIL;
+
+    bfd*         abfd   = file->abfd;
+    bfd_lookup_t lookup = {.syms = file->syms, .pc = addr};
+
+    bfd_map_over_sections(abfd, find_address_in_section, &lookup);
+
+    if (!isvalid(lookup.filename))
+        FAIL;
+
+    char* alloc = NULL;
+    if (lookup.functionname == NULL || *lookup.functionname == '\0')
+        alloc = strdup("<unnamed>");
+    else {
+#ifdef HAVE_LIBERTY
+        alloc = bfd_demangle(abfd, lookup.functionname, DMGL_PARAMS | DMGL_ANSI);
 #endif
+        if (alloc == NULL)
+            alloc = strdup(lookup.functionname);
+    }
+    if (!isvalid(alloc)) // GCOV_EXCL_LINE
+        FAIL;            // GCOV_EXCL_LINE
+
+    *source = lookup.filename;
+    *name   = alloc;
+    *lineno = lookup.line;
 
-    free(syms);
-    syms = NULL;
+    SUCCESS;
+}
 
-    frame_t* frame = isvalid(filename) && isvalid(name) ? frame_new(
-                                                              frame_key, cached_string_new(0, (char*)filename),
-                                                              cached_string_new(0, (char*)name), line, 0, 0, 0
-                                                          )
-                                                        : NULL;
+// ----------------------------------------------------------------------------
+static inline frame_t*
+get_native_frame(const char* file_name, bfd_vma addr, key_dt frame_key) {
+    const char*  source;
+    char*        name;
+    unsigned int lineno;
 
-    bfd_close(abfd);
+    if (fail(resolve_native_location(file_name, addr, &source, &name, &lineno)))
+        FAIL_PTR;
+
+    return frame_new(frame_key, cached_string_new(0, (char*)source), cached_string_new(0, name), lineno, 0, 0, 0);
+}
+
+// ----------------------------------------------------------------------------
+static inline void
+bfd_files__destroy(void) {
+    if (!isvalid(_bfd_files))
+        return;
+
+    hash_table__iter_start(_bfd_files->hash, bfd_file_t*, head) {
+        for (bfd_file_t *file = head, *next; isvalid(file); file = next) {
+            next = file->next;
+            bfd_file__destroy(file);
+        }
+    }
+    hash_table__iter_stop(_bfd_files->hash);
 
-    return frame;
+    lookup__destroy(_bfd_files);
+    _bfd_files = NULL;
 }
@@ -10,20 +10,12 @@ _get_base_64(Elf64_Ehdr* ehdr, void* elf_map) {
 } /* _get_base_64 */
 
 static int
-_py_proc__analyze_elf64(py_proc_t* self, void* elf_map, void* elf_base, proc_vm_map_block_t* bss) {
+_py_proc__analyze_elf64(py_proc_t* self, elf_file_t* elf, void* elf_base, proc_vm_map_block_t* bss) {
     register int symbols = 0;
 
-    Elf64_Ehdr* ehdr = elf_map;
-
-    // Section header must be read from binary as it is not loaded into memory
-    Elf64_Xword sht_size     = ehdr->e_shnum * ehdr->e_shentsize;
-    Elf64_Off   elf_map_size = ehdr->e_shoff + sht_size;
-    Elf64_Shdr* p_shdr;
-
-    Elf64_Shdr* p_shstrtab   = elf_map + ELF_SH_OFF(ehdr, ehdr->e_shstrndx);
-    char*       sh_name_base = elf_map + p_shstrtab->sh_offset;
-    Elf64_Shdr* p_dynsym     = NULL;
-    Elf64_Addr  base         = _get_base_64(ehdr, elf_map);
+    void*       elf_map = elf_file__addr(elf);
+    Elf64_Ehdr* ehdr    = elf_map;
+    Elf64_Addr  base    = _get_base_64(ehdr, elf_map);
 
     void*  bss_base = NULL;
     size_t bss_size = 0;
@@ -31,29 +23,30 @@ _py_proc__analyze_elf64(py_proc_t* self, void* elf_map, void* elf_base, proc_vm_
     if (base != UINT64_MAX) {
         log_d("ELF base @ %p", base);
 
-        for (Elf64_Off sh_off = ehdr->e_shoff; sh_off < elf_map_size; sh_off += ehdr->e_shentsize) {
-            p_shdr = (Elf64_Shdr*)(elf_map + sh_off);
+        elf_section_t* p_dynsym  = elf_file__section(elf, ".dynsym");
+        elf_section_t* p_bss     = elf_file__section(elf, ".bss");
+        elf_section_t* p_runtime = elf_file__section(elf, ".PyRuntime");
+        elf_section_t* p_rodata  = elf_file__section(elf, ".rodata");
 
-            if (p_shdr->sh_type == SHT_DYNSYM && strcmp(sh_name_base + p_shdr->sh_name, ".dynsym") == 0) {
-                p_dynsym = p_shdr;
-            } else if (strcmp(sh_name_base + p_shdr->sh_name, ".bss") == 0) {
-                bss_base = elf_base + (p_shdr->sh_addr - base);
-                bss_size = p_shdr->sh_size;
-            } else if (strcmp(sh_name_base + p_shdr->sh_name, ".PyRuntime") == 0) {
-                self->map.runtime.base = elf_base + (p_shdr->sh_addr - base);
-                self->map.runtime.size = p_shdr->sh_size;
-            }
+        if (isvalid(p_bss)) {
+            bss_base = elf_base + (p_bss->addr - base);
+            bss_size = p_bss->size;
         }
 
-        if (isvalid(p_dynsym)) {
-            if (p_dynsym->sh_offset != 0) {
-                Elf64_Shdr* p_strtabsh = (Elf64_Shdr*)(elf_map + ELF_SH_OFF(ehdr, p_dynsym->sh_link));
+        if (isvalid(p_runtime)) {
+            self->map.runtime.base = elf_base + (p_runtime->addr - base);
+            self->map.runtime.size = p_runtime->size;
+        }
+
+        if (isvalid(p_dynsym) && p_dynsym->type == SHT_DYNSYM && p_dynsym->link < elf->n_sections) {
+            if (p_dynsym->offset != 0) {
+                elf_section_t* p_strtabsh = elf->sections + p_dynsym->link;
 
                 // Search for dynamic symbols
-                for (Elf64_Off tab_off  = p_dynsym->sh_offset; tab_off < p_dynsym->sh_offset + p_dynsym->sh_size;
-                     tab_off           += p_dynsym->sh_entsize) {
+                for (Elf64_Off tab_off  = p_dynsym->offset; tab_off < p_dynsym->offset + p_dynsym->size;
+                     tab_off           += p_dynsym->entsize) {
                     Elf64_Sym* sym      = (Elf64_Sym*)(elf_map + tab_off);
-                    char*      sym_name = (char*)(elf_map + p_strtabsh->sh_offset + sym->st_name);
+                    char*      sym_name = (char*)(elf_map + p_strtabsh->offset + sym->st_name);
                     void*      value    = elf_base + (sym->st_value - base);
                     if ((symbols += _py_proc__check_sym(self, sym_name, value)) >= DYNSYM_COUNT) {
                         // We have found all the symbols. No need to look further
@@ -62,6 +55,15 @@ _py_proc__analyze_elf64(py_proc_t* self, void* elf_map, void* elf_base, proc_vm_
                 }
             }
         }
+
+        // The Py_Version symbol is more reliable, so we only look for the
+        // version string in the read-only data of binaries that do not export it.
+        if (isvalid(p_rodata) && p_rodata->type == SHT_PROGBITS && !isvalid(self->symbols[DYNSYM_HEX_VERSION])
+            && p_rodata->offset <= elf_file__size(elf) && p_rodata->size <= elf_file__size(elf) - p_rodata->offset) {
+            int version = find_version_string(elf_file__data(elf, p_rodata->offset), p_rodata->size);
+            if (version)
+                self->bin_version = version;
+        }
     }
 
     if (symbols < DYNSYM_MANDATORY) {
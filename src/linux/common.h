@@ -28,20 +28,41 @@
 #include <string.h>
 #include <sys/ptrace.h>
 
+#include "../cache.h"
 #include "../error.h"
 #include "../hints.h"
+#include "../platform.h"
 #include "../stats.h"
 
 #define PTHREAD_BUFFER_ITEMS 200
 
+struct _elf_file;
+struct _proc_maps;
+
 struct _proc_extra_info {
-    unsigned int page_size;
-    char         statm_file[24];
-    pthread_t    wait_thread_id;
-    unsigned int pthread_tid_offset;
-    uintptr_t    _pthread_buffer[PTHREAD_BUFFER_ITEMS];
+    unsigned int       page_size;
+    int                statm_fd;
+    pthread_t          wait_thread_id;
+#ifdef NATIVE
+    pthread_mutex_t    wait_lock;
+    int                wait_status; // A stop of the main thread reaped by the wait thread, or -1
+#endif
+    unsigned int       pthread_tid_offset;
+    uintptr_t          _pthread_buffer[PTHREAD_BUFFER_ITEMS];
+    lru_cache_t*       pthread_tid_cache; // The TID of each thread state
+    struct _elf_file*  bin_elf;
+    struct _elf_file*  lib_elf;
+    struct _proc_maps* maps;
+    unsigned int       vm_maps_generation;
 };
 
+// The TID of a thread, as resolved from the pthread_t of its thread state.
+typedef struct {
+    uint64_t  id; // The unique ID of the thread state
+    uintptr_t thread_id;
+    uintptr_t tid;
+} pthread_tid_t;
+
 #define read_pthread_t(py_proc, addr)                                                                           \
     (copy_memory(py_proc->ref, addr, sizeof(py_proc->extra->_pthread_buffer), py_proc->extra->_pthread_buffer))
 
@@ -0,0 +1,297 @@
+// This file is part of "austin" which is released under GPL.
+//
+// See file LICENCE or go to http://www.gnu.org/licenses/ for full license
+// details.
+//
+// Austin is a Python frame stack sampler for CPython.
+//
+// Copyright (c) 2018-2025 Gabriele N. Tornetta <phoenix1987@gmail.com>.
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <elf.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../cache.h"
+#include "../error.h"
+#include "../hints.h"
+#include "../py_string.h"
+#include "../resources.h"
+
+// ----------------------------------------------------------------------------
+
+// A class-independent view of an ELF section header.
+typedef struct {
+    char*    name;
+    uint32_t type;
+    uint64_t addr;
+    uint64_t offset;
+    uint64_t size;
+    uint64_t entsize;
+    uint32_t link;
+} elf_section_t;
+
+// A read-only mapping of an ELF file, shared by all the consumers that open
+// the same path. The section headers are indexed by name hash on creation.
+typedef struct _elf_file {
+    char*          path;
+    int            refs;
+    map_t*         map;
+    int            elf_class;
+    elf_section_t* sections;
+    size_t         n_sections;
+    hash_table_t*  section_table;
+
+    struct _elf_file* next;
+} elf_file_t;
+
+#define elf_file__size(self) ((self)->map->size)
+#define elf_file__addr(self) ((self)->map->addr)
+#define elf_file__data(self, offset) ((void*)((char*)(self)->map->addr + (offset)))
+
+// The files currently mapped. The list is shared with the native symbolizer
+// thread, hence the lock.
+static elf_file_t*     _elf_files     = NULL;
+static pthread_mutex_t _elf_files_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// ----------------------------------------------------------------------------
+static inline void
+_elf_file__destroy(elf_file_t* self) {
+    if (!isvalid(self))
+        return;
+
+    hash_table__destroy(self->section_table);
+    sfree(self->sections);
+    map__destroy(self->map);
+    sfree(self->path);
+
+    free(self);
+}
+
+// ----------------------------------------------------------------------------
+// Section names are offsets into the section name string table, and must be
+// NUL-terminated within it.
+static inline char*
+_elf_file__section_name(elf_file_t* self, uint64_t strtab_offset, uint64_t strtab_size, uint64_t name) {
+    if (name >= strtab_size)
+        return "";
+
+    char* string = elf_file__data(self, strtab_offset + name);
+
+    return memchr(string, '\0', strtab_size - name) != NULL ? string : "";
+}
+
+// ----------------------------------------------------------------------------
+static inline void
+_elf_file__set_section(
+    elf_file_t* self, size_t i, char* name, uint32_t type, uint64_t addr, uint64_t offset, uint64_t size,
+    uint64_t entsize, uint32_t link
+) {
+    elf_section_t* section = self->sections + i;
+
+    section->name    = name;
+    section->type    = type;
+    section->addr    = addr;
+    section->offset  = offset;
+    section->size    = size;
+    section->entsize = entsize;
+    section->link    = link;
+}
+
+#define _ELF_FILE_INDEX(self, bits)                                                                            \
+    {                                                                                                          \
+        Elf##bits##_Ehdr* ehdr = (Elf##bits##_Ehdr*)elf_file__addr(self);                                      \
+        if (ehdr->e_shentsize < sizeof(Elf##bits##_Shdr) || ehdr->e_shoff > elf_file__size(self)               \
+            || (uint64_t)ehdr->e_shnum * ehdr->e_shentsize > elf_file__size(self) - ehdr->e_shoff              \
+            || ehdr->e_shstrndx >= ehdr->e_shnum) {                                                            \
+            set_error(BINARY, "Bad ELF section header table");                                                 \
+            FAIL;                                                                                              \
+        }                                                                                                      \
+        Elf##bits##_Shdr* strtab = elf_file__data(self, ehdr->e_shoff + ehdr->e_shstrndx * ehdr->e_shentsize); \
+        if (strtab->sh_offset > elf_file__size(self)                                                           \
+            || strtab->sh_size > elf_file__size(self) - strtab->sh_offset) {                                   \
+            set_error(BINARY, "Bad ELF section name table");                                                   \
+            FAIL;                                                                                              \
+        }                                                                                                      \
+        self->n_sections = ehdr->e_shnum;                                                                      \
+        self->sections   = (elf_section_t*)calloc(self->n_sections, sizeof(elf_section_t));                    \
+        if (!isvalid(self->sections)) {                                                                        \
+            set_error(MALLOC, "Cannot allocate memory for ELF sections");                                      \
+            FAIL;                                                                                              \
+        }                                                                                                      \
+        for (size_t i = 0; i < self->n_sections; i++) {                                                        \
+            Elf##bits##_Shdr* shdr = elf_file__data(self, ehdr->e_shoff + i * ehdr->e_shentsize);              \
+            _elf_file__set_section(                                                                            \
+                self, i, _elf_file__section_name(self, strtab->sh_offset, strtab->sh_size, shdr->sh_name),     \
+                shdr->sh_type, shdr->sh_addr, shdr->sh_offset, shdr->sh_size, shdr->sh_entsize, shdr->sh_link  \
+            );                                                                                                 \
+        }                                                                                                      \
+    }
+
+static inline int
+_elf_file__index_sections(elf_file_t* self) {
+    Elf64_Ehdr* ehdr = (Elf64_Ehdr*)elf_file__addr(self);
+
+    if (elf_file__size(self) < sizeof(Elf64_Ehdr) || memcmp(ehdr->e_ident, ELFMAG, SELFMAG) || ehdr->e_shoff == 0
+        || ehdr->e_shnum < 2) {
+        set_error(BINARY, "Bad ELF header");
+        FAIL;
+    }
+
+    self->elf_class = ehdr->e_ident[EI_CLASS];
+    switch (self->elf_class) {
+    case ELFCLASS64:
+        _ELF_FILE_INDEX(self, 64);
+        break;
+
+    case ELFCLASS32: // GCOV_EXCL_START
+        _ELF_FILE_INDEX(self, 32);
+        break;
+
+    default:
+        set_error(BINARY, "Invalid ELF class");
+        FAIL;
+    } // GCOV_EXCL_STOP
+
+    self->section_table = hash_table_new((self->n_sections * 4 / 3) | 1);
+    if (!isvalid(self->section_table)) { // GCOV_EXCL_START
+        set_error(MALLOC, "Cannot allocate memory for ELF section table");
+        FAIL;
+    } // GCOV_EXCL_STOP
+
+    // Index in reverse so that the first section with a given name wins.
+    for (size_t i = self->n_sections; i-- > 0;) {
+        if (*self->sections[i].name != '\0')
+            hash_table__set(self->section_table, string__hash(self->sections[i].name), self->sections + i);
+    }
+
+    SUCCESS;
+}
+
+// ----------------------------------------------------------------------------
+static inline elf_file_t*
+_elf_file__open(char* path) {
+    for (elf_file_t* elf = _elf_files; isvalid(elf); elf = elf->next) {
+        if (strcmp(elf->path, path) == 0) {
+            elf->refs++;
+            return elf;
+        }
+    }
+
+    cu_fd fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        set_error(IO, "Cannot open binary file");
+        FAIL_PTR;
+    }
+
+    struct stat s;
+    if (fstat(fd, &s) == -1) { // GCOV_EXCL_START
+        set_error(IO, "Cannot determine size of binary file");
+        FAIL_PTR;
+    } // GCOV_EXCL_STOP
+
+    elf_file_t* elf = (elf_file_t*)calloc(1, sizeof(elf_file_t));
+    if (!isvalid(elf)) { // GCOV_EXCL_START
+        set_error(MALLOC, "Cannot allocate memory for ELF file");
+        FAIL_PTR;
+    } // GCOV_EXCL_STOP
+
+    elf->path = strdup(path);
+    elf->map  = map_new(fd, s.st_size, MAP_PRIVATE);
+    if (!isvalid(elf->path) || !isvalid(elf->map) || fail(_elf_file__index_sections(elf))) {
+        _elf_file__destroy(elf);
+        FAIL_PTR;
+    }
+
+    elf->refs  = 1;
+    elf->next  = _elf_files;
+    _elf_files = elf;
+
+    return elf;
+}
+
+// ----------------------------------------------------------------------------
+/**
+ * Open an ELF file. If the file is already open, the existing mapping is
+ * shared and its reference count is increased.
+ *
+ * @param path  the path of the ELF file
+ *
+ * @return a valid reference to an ELF file object, NULL otherwise.
+ */
+static inline elf_file_t*
+elf_file_open(char* path) {
+    if (!isvalid(path)) { // GCOV_EXCL_START
+        set_error(NULL, "Invalid ELF file path");
+        FAIL_PTR;
+    } // GCOV_EXCL_STOP
+
+    pthread_mutex_lock(&_elf_files_lock);
+    elf_file_t* elf = _elf_file__open(path);
+    pthread_mutex_unlock(&_elf_files_lock);
+
+    return elf;
+}
+
+// ----------------------------------------------------------------------------
+/**
+ * Release a reference to an ELF file. The file is unmapped when the last
+ * reference is released.
+ *
+ * @param self  the ELF file object
+ */
+static inline void
+elf_file__close(elf_file_t* self) {
+    if (!isvalid(self))
+        return;
+
+    pthread_mutex_lock(&_elf_files_lock);
+    if (--self->refs == 0) {
+        for (elf_file_t** elf = &_elf_files; isvalid(*elf); elf = &(*elf)->next) {
+            if (*elf == self) {
+                *elf = self->next;
+                break;
+            }
+        }
+        _elf_file__destroy(self);
+    }
+    pthread_mutex_unlock(&_elf_files_lock);
+}
+
+CLEANUP_TYPE(elf_file_t, elf_file__close);
+#define cu_elf_file_t __attribute__((cleanup(elf_file__closet))) elf_file_t
+
+// ----------------------------------------------------------------------------
+/**
+ * Look up a section by name.
+ *
+ * @param self  the ELF file object
+ * @param name  the section name, e.g. ".bss"
+ *
+ * @return the section, or NULL if the file has no such section.
+ */
+static inline elf_section_t*
+elf_file__section(elf_file_t* self, char* name) {
+    elf_section_t* section = hash_table__get(self->section_table, string__hash(name));
+
+    return isvalid(section) && strcmp(section->name, name) == 0 ? section : NULL;
+}
@@ -22,11 +22,16 @@
 
 #pragma once
 
+#include <fcntl.h>
+#include <linux/fs.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
 
 #include "../../error.h"
+#include "../../mem.h"
 #include "../../resources.h"
 #include "../common.h"
 
@@ -47,19 +52,81 @@ typedef struct _proc_map {
 
 #define PROC_MAP_ITER(proc_maps, map) for (proc_map_t* map = proc_maps; isvalid(map); map = map->next)
 
+// The parsed content of /proc/<pid>/maps. The maps are stored in a flat array,
+// in the same (ascending) address order as the file, and are also chained
+// through their next field so that they can be iterated from any entry with
+// PROC_MAP_ITER. The raw read buffer is kept untouched so that it can be
+// compared with the next read, and path names are copied into a separate
+// NUL-terminated string area.
+typedef struct _proc_maps {
+    pid_t       pid;
+    int         fd;
+    char*       buffer;
+    size_t      size;
+    size_t      capacity;
+    char*       scratch;
+    size_t      scratch_capacity;
+    char*       names;
+    size_t      names_capacity;
+    proc_map_t* maps;
+    size_t      count;
+    size_t      maps_capacity;
+
+    // Bumped every time the content of the maps file changes.
+    unsigned int generation;
+} proc_maps_t;
+
+#define proc_maps__head(self) ((self)->count ? (self)->maps : NULL)
+
 // ----------------------------------------------------------------------------
-static inline proc_map_t*
-proc_map_new(pid_t pid) {
-    cu_char*    line           = NULL;
-    size_t      len            = 0;
-    char        pathname[1024] = {0};
-    char        perms[5]       = {0};
-    proc_map_t* head           = NULL;
-    proc_map_t* curr           = NULL;
-    proc_map_t* next           = NULL;
-
-    cu_FILE* fp = _procfs(pid, "maps");
-    if (!isvalid(fp)) { // GCOV_EXCL_START
+static inline char*
+_proc_maps__parse_hex(char* p, size_t* value) {
+    size_t v = 0;
+
+    for (;; p++) {
+        unsigned int d = (unsigned char)*p - '0';
+        unsigned int h = ((unsigned char)*p | 0x20) - 'a';
+        if (d < 10)
+            v = (v << 4) | d;
+        else if (h < 6)
+            v = (v << 4) | (h + 10);
+        else
+            break;
+    }
+
+    *value = v;
+
+    return p;
+}
+
+// ----------------------------------------------------------------------------
+static inline char*
+_proc_maps__skip_field(char* p, char* end) {
+    while (p < end && *p != ' ' && *p != '\n')
+        p++;
+    while (p < end && *p == ' ')
+        p++;
+
+    return p;
+}
+
+// ----------------------------------------------------------------------------
+// Read the whole maps file into the scratch buffer. Returns the number of bytes
+// read, or -1 on error.
+static inline ssize_t
+_proc_maps__read(proc_maps_t* self) {
+    size_t size = 0;
+    char   path[32];
+
+    // The maps file is bound to the address space the process had when it was
+    // opened, so we need to re-open it every time to see through an exec.
+    if (self->fd >= 0)
+        close(self->fd);
+
+    sprintf(path, "/proc/%d/maps", self->pid);
+
+    self->fd = open(path, O_RDONLY);
+    if (self->fd == -1) { // GCOV_EXCL_START
         switch (errno) {
         case EACCES: // Needs elevated privileges
             set_error(PERM, "Cannot read from procfs");
@@ -70,56 +137,305 @@ proc_map_new(pid_t pid) {
         default:
             set_error(OS, "Unknown error");
         }
-        FAIL_PTR;
+        FAIL_INT;
     } // GCOV_EXCL_STOP
 
-    while (getline(&line, &len, fp) != -1) {
-        ssize_t lower, upper;
-
-        int has_pathname = sscanf(
-                               line, "%zx-%zx %s %*x %*x:%*x %*x %s\n", &lower,
-                               &upper,  // Map bounds
-                               perms,   // Permissions
-                               pathname // Binary path
-                           )
-                         - 3; // We expect between 3 and 4 matches. We skip offset, dev and inode
-
-        if (has_pathname < 0) {
-            // Too few columns. This shouldn't happen but we skip this case
-            // anyway.
-            continue;
+    for (;;) {
+        if (self->scratch_capacity - size < 4096) {
+            size_t capacity = self->scratch_capacity ? self->scratch_capacity << 1 : 1 << 16;
+            char*  resized  = (char*)realloc(self->scratch, capacity);
+            if (!isvalid(resized)) { // GCOV_EXCL_START
+                set_error(MALLOC, "Cannot allocate memory for memory maps");
+                FAIL_INT;
+            } // GCOV_EXCL_STOP
+            self->scratch          = resized;
+            self->scratch_capacity = capacity;
         }
-        if (has_pathname && pathname[0] == '[') {
-            // Skip kernel memory maps
-            continue;
+
+        // Leave room for a NUL terminator.
+        ssize_t n = read(self->fd, self->scratch + size, self->scratch_capacity - size - 1);
+        if (n == -1) {
+            if (errno == EINTR) // GCOV_EXCL_LINE
+                continue;       // GCOV_EXCL_LINE
+            set_error(OS, "Cannot read memory maps");
+            FAIL_INT;
         }
+        if (n == 0)
+            break;
+
+        size += n;
+    }
+
+    self->scratch[size] = '\0';
 
-        next = (proc_map_t*)calloc(1, sizeof(proc_map_t));
-        if (!isvalid(next)) { // GCOV_EXCL_START
-            set_error(MALLOC, "Cannot allocate memory for proc_map_t");
-            FAIL_PTR;
+    return size;
+}
+
+// ----------------------------------------------------------------------------
+static inline int
+_proc_maps__parse(proc_maps_t* self) {
+    char* p   = self->buffer;
+    char* end = self->buffer + self->size;
+
+    // Every path name is followed by a new line in the raw buffer, so the
+    // copies, with their NUL terminators, never need more room than that. We
+    // size the string area once so that the path names never move.
+    if (self->names_capacity < self->size + 1) {
+        char* resized = (char*)realloc(self->names, self->size + 1);
+        if (!isvalid(resized)) { // GCOV_EXCL_START
+            set_error(MALLOC, "Cannot allocate memory for memory map path names");
+            FAIL;
         } // GCOV_EXCL_STOP
-        if (!isvalid(head))
-            head = next;
-        else
-            curr->next = next;
+        self->names          = resized;
+        self->names_capacity = self->size + 1;
+    }
+
+    char* names = self->names;
+
+    self->count = 0;
+
+    while (p < end) {
+        char*  eol = memchr(p, '\n', end - p);
+        size_t lower, upper;
+
+        if (!isvalid(eol))
+            eol = end;
+
+        p = _proc_maps__parse_hex(p, &lower);
+        if (*p++ != '-')
+            goto next; // GCOV_EXCL_LINE
+        p = _proc_maps__parse_hex(p, &upper);
+        if (*p++ != ' ' || eol - p < 4)
+            goto next; // GCOV_EXCL_LINE
+
+        if (self->count == self->maps_capacity) {
+            size_t      capacity = self->maps_capacity ? self->maps_capacity << 1 : 256;
+            proc_map_t* resized  = (proc_map_t*)realloc(self->maps, capacity * sizeof(proc_map_t));
+            if (!isvalid(resized)) { // GCOV_EXCL_START
+                set_error(MALLOC, "Cannot allocate memory for proc_map_t");
+                FAIL;
+            } // GCOV_EXCL_STOP
+            self->maps          = resized;
+            self->maps_capacity = capacity;
+        }
+
+        proc_map_t* map = self->maps + self->count++;
+
+        map->address = (void*)lower;
+        map->size    = upper - lower;
+        map->perms   = (PERMS_READ * (p[0] == 'r')) | (PERMS_WRITE * (p[1] == 'w')) | (PERMS_EXEC * (p[2] == 'x'));
 
-        curr = next;
+        // Skip permissions, offset, device and inode
+        for (int i = 0; i < 4; i++)
+            p = _proc_maps__skip_field(p, eol);
 
-        curr->address   = (void*)lower;
-        curr->size      = upper - lower;
-        curr->perms    |= PERMS_READ * (perms[0] == 'r');
-        curr->perms    |= PERMS_WRITE * (perms[1] == 'w');
-        curr->perms    |= PERMS_EXEC * (perms[2] == 'x');
-        curr->pathname  = has_pathname ? strdup(pathname) : NULL;
+        // The path name is the rest of the line, and it might contain spaces.
+        if (p < eol) {
+            size_t len = eol - p;
+            memcpy(names, p, len);
+            names[len]    = '\0';
+            map->pathname = names;
+            names += len + 1;
+        } else {
+            map->pathname = NULL;
+        }
+
+    next:
+        p = eol + 1;
     }
 
-    if (!isvalid(head)) {
+    // Chain the entries only once the array has stopped moving.
+    for (size_t i = 0; i < self->count; i++)
+        self->maps[i].next = i + 1 < self->count ? self->maps + i + 1 : NULL;
+
+    if (self->count == 0) {
         set_error(OS, "No memory maps found");
+        FAIL;
+    }
+
+    SUCCESS;
+}
+
+// ----------------------------------------------------------------------------
+/**
+ * Re-read the memory maps of the process. The maps are parsed again only if
+ * the content of the maps file has changed since the last refresh, in which
+ * case the generation counter is increased. Consumers can compare the
+ * generation with the one they last saw to decide whether to rebuild any
+ * derived data.
+ *
+ * @param self  the proc maps object
+ *
+ * @return SUCCESS or FAIL.
+ */
+static inline int
+proc_maps__refresh(proc_maps_t* self) {
+    ssize_t size = _proc_maps__read(self);
+    if (size < 0)
+        FAIL;
+
+    if (self->count > 0 && (size_t)size == self->size && memcmp(self->scratch, self->buffer, size) == 0)
+        SUCCESS;
+
+    // Swap the buffers. The path names in the old maps are invalidated by the
+    // parse below.
+    char*  buffer          = self->buffer;
+    size_t capacity        = self->capacity;
+    self->buffer           = self->scratch;
+    self->capacity         = self->scratch_capacity;
+    self->size             = size;
+    self->scratch          = buffer;
+    self->scratch_capacity = capacity;
+
+    if (fail(_proc_maps__parse(self)))
+        FAIL;
+
+    self->generation++;
+
+    SUCCESS;
+}
+
+// ----------------------------------------------------------------------------
+static inline void
+proc_maps__destroy(proc_maps_t* self) {
+    if (!isvalid(self))
+        return;
+
+    if (self->fd >= 0)
+        close(self->fd);
+
+    sfree(self->buffer);
+    sfree(self->scratch);
+    sfree(self->names);
+    sfree(self->maps);
+
+    free(self);
+}
+
+CLEANUP_TYPE(proc_maps_t, proc_maps__destroy);
+#define cu_proc_maps_t __attribute__((cleanup(proc_maps__destroyt))) proc_maps_t
+
+// ----------------------------------------------------------------------------
+static inline proc_maps_t*
+proc_maps_new(pid_t pid) {
+    proc_maps_t* self = (proc_maps_t*)calloc(1, sizeof(proc_maps_t));
+    if (!isvalid(self)) { // GCOV_EXCL_START
+        set_error(MALLOC, "Cannot allocate memory for proc_maps_t");
+        FAIL_PTR;
+    } // GCOV_EXCL_STOP
+
+    self->pid = pid;
+    self->fd  = -1;
+
+    if (fail(proc_maps__refresh(self))) {
+        proc_maps__destroy(self);
+        FAIL_PTR;
+    }
+
+    return self;
+}
+
+// ----------------------------------------------------------------------------
+// PROCMAP_QUERY (Linux 6.11+) lets us look up a single mapping by address
+// without reading the whole maps file. Older headers do not define it, but the
+// ABI is stable, so we provide our own definition.
+#ifndef PROCMAP_QUERY
+struct procmap_query {
+    uint64_t size;
+    uint64_t query_flags;
+    uint64_t query_addr;
+    uint64_t vma_start;
+    uint64_t vma_end;
+    uint64_t vma_flags;
+    uint64_t vma_page_size;
+    uint64_t vma_offset;
+    uint64_t inode;
+    uint32_t dev_major;
+    uint32_t dev_minor;
+    uint32_t vma_name_size;
+    uint32_t build_id_size;
+    uint64_t vma_name_addr;
+    uint64_t build_id_addr;
+};
+
+#define PROCMAP_QUERY                 _IOWR('f', 17, struct procmap_query)
+#define PROCMAP_QUERY_FILE_BACKED_VMA 0x20
+#endif
+
+/**
+ * Check whether the given address falls within a file-backed mapping.
+ *
+ * @param self  the proc maps object
+ * @param addr  the address to look up
+ *
+ * @return 1 if the address is file-backed, 0 if it is not, or -1 if the
+ *         kernel cannot answer the query, in which case the maps file should
+ *         be read instead.
+ */
+static inline int
+proc_maps__is_file_backed(proc_maps_t* self, void* addr) {
+    static bool unsupported = false;
+
+    if (unsupported)
+        return -1;
+
+    struct procmap_query query = {
+        .size        = sizeof(struct procmap_query),
+        .query_flags = PROCMAP_QUERY_FILE_BACKED_VMA,
+        .query_addr  = (uint64_t)(uintptr_t)addr,
+    };
+
+    if (ioctl(self->fd, PROCMAP_QUERY, &query) == 0)
+        return 1;
+
+    if (errno == ENOENT)
+        return 0;
+
+    if (errno == ENOTTY || errno == EINVAL)
+        unsupported = true;
+
+    return -1;
+}
+
+// ----------------------------------------------------------------------------
+// Collect the writable memory ranges of the process, including the heap and
+// any anonymous mappings, sorted by address. Adjacent ranges are coalesced.
+static inline addr_range_t*
+proc_maps__writable_ranges(proc_maps_t* self, size_t* count) {
+    size_t n = 0;
+
+    addr_range_t* ranges = (addr_range_t*)malloc(self->count * sizeof(addr_range_t));
+    if (!isvalid(ranges)) { // GCOV_EXCL_START
+        set_error(MALLOC, "Cannot allocate memory for writable ranges");
         FAIL_PTR;
+    } // GCOV_EXCL_STOP
+
+    for (size_t i = 0; i < self->count; i++) {
+        proc_map_t* map = self->maps + i;
+        if (!(map->perms & PERMS_WRITE))
+            continue;
+
+        raddr_t lower = (raddr_t)map->address;
+        raddr_t upper = (raddr_t)map->address + map->size;
+
+        if (n > 0 && ranges[n - 1].hi == lower) {
+            ranges[n - 1].hi = upper;
+            continue;
+        }
+
+        ranges[n].lo   = lower;
+        ranges[n++].hi = upper;
     }
 
-    return head;
+    if (n == 0) {
+        free(ranges);
+        set_error(OS, "No writable memory maps found");
+        FAIL_PTR;
+    }
+
+    *count = n;
+
+    return ranges;
 }
 
 // ----------------------------------------------------------------------------
@@ -153,19 +469,3 @@ proc_map__first_submatch(proc_map_t* self, char* needle) {
 
     return NULL;
 }
-
-// ----------------------------------------------------------------------------
-static inline void
-proc_map__destroy(proc_map_t* self) {
-    if (!isvalid(self))
-        return;
-
-    proc_map__destroy(self->next);
-
-    sfree(self->pathname);
-
-    free(self);
-}
-
-CLEANUP_TYPE(proc_map_t, proc_map__destroy);
-#define cu_proc_map_t __attribute__((cleanup(proc_map__destroyt))) proc_map_t
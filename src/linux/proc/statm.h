@@ -0,0 +1,71 @@
+// This file is part of "austin" which is released under GPL.
+//
+// See file LICENCE or go to http://www.gnu.org/licenses/ for full license
+// details.
+//
+// Austin is a Python frame stack sampler for CPython.
+//
+// Copyright (c) 2018-2021 Gabriele N. Tornetta <phoenix1987@gmail.com>.
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+
+#include <unistd.h>
+
+#include "../../error.h"
+#include "../../hints.h"
+
+// ----------------------------------------------------------------------------
+// Parse the number of resident pages from the content of /proc/<pid>/statm.
+// This is the second field of the file.
+//
+// @param buffer  the NUL-terminated content of the statm file
+//
+// @return the number of resident pages, or -1 on failure.
+static ssize_t
+proc_statm_parse_resident(const char* buffer) {
+    const char* p = buffer;
+    while (*p >= '0' && *p <= '9')
+        p++;
+    if (p == buffer || *p++ != ' ' || *p < '0' || *p > '9') {
+        set_error(OS, "Failed to parse statm file");
+        FAIL_INT;
+    }
+
+    ssize_t resident = 0;
+    while (*p >= '0' && *p <= '9')
+        resident = resident * 10 + (*p++ - '0');
+
+    return resident;
+}
+
+// ----------------------------------------------------------------------------
+// Read the number of resident pages from an open statm file. The file is read
+// from the start so that the same descriptor can be used for every reading.
+//
+// @param fd  the descriptor of the open /proc/<pid>/statm file
+//
+// @return the number of resident pages, or -1 on failure.
+static ssize_t
+proc_statm_read_resident(int fd) {
+    char    buffer[128];
+    ssize_t n = pread(fd, buffer, sizeof(buffer) - 1, 0);
+    if (n <= 0) { // GCOV_EXCL_START
+        set_error(IO, "Cannot read statm file");
+        FAIL_INT;
+    } // GCOV_EXCL_STOP
+    buffer[n] = '\0';
+
+    return proc_statm_parse_resident(buffer);
+}
@@ -39,9 +39,11 @@
 #include "../platform.h"
 #include "../resources.h"
 #include "common.h"
+#include "elf-file.h"
 #include "futils.h"
 #include "proc/exe.h"
 #include "proc/maps.h"
+#include "proc/statm.h"
 
 #ifdef NATIVE
 #include "../argparse.h"
@@ -57,18 +59,33 @@
 #define RODATA_MAP (1 << 2)
 #define BSS_MAP    (1 << 3)
 
-// Get the offset of the ith section header
-#define ELF_SH_OFF(ehdr, i) /* as */ (ehdr->e_shoff + i * ehdr->e_shentsize)
-
 union {
     Elf32_Ehdr v32;
     Elf64_Ehdr v64;
 } ehdr_v;
 
 // ----------------------------------------------------------------------------
+// Wait for the child process to terminate, so that it does not become a
+// zombie. In native mode the main thread of the child might be traced, and its
+// ptrace stops would be reaped here too. These are handed over to the sampler,
+// which is waiting for them.
 static void*
 wait_thread(void* py_proc) {
-    waitpid(((py_proc_t*)py_proc)->pid, 0, 0);
+    py_proc_t* self = (py_proc_t*)py_proc;
+    int        status;
+
+    while (waitpid(self->pid, &status, 0) == self->pid) {
+#ifdef NATIVE
+        if (WIFSTOPPED(status)) {
+            pthread_mutex_lock(&self->extra->wait_lock);
+            self->extra->wait_status = status;
+            pthread_mutex_unlock(&self->extra->wait_lock);
+            continue;
+        }
+#endif
+        break;
+    }
+
     return NULL;
 }
 
@@ -104,20 +121,12 @@ _get_base_64(Elf64_Ehdr* ehdr, void* elf_map) {
 } /* _get_base_64 */
 
 static int
-_py_proc__analyze_elf64(py_proc_t* self, void* elf_map, void* elf_base, proc_vm_map_block_t* bss) {
+_py_proc__analyze_elf64(py_proc_t* self, elf_file_t* elf, void* elf_base, proc_vm_map_block_t* bss) {
     register int symbols = 0;
 
-    Elf64_Ehdr* ehdr = elf_map;
-
-    // Section header must be read from binary as it is not loaded into memory
-    Elf64_Xword sht_size     = ehdr->e_shnum * ehdr->e_shentsize;
-    Elf64_Off   elf_map_size = ehdr->e_shoff + sht_size;
-    Elf64_Shdr* p_shdr;
-
-    Elf64_Shdr* p_shstrtab   = elf_map + ELF_SH_OFF(ehdr, ehdr->e_shstrndx);
-    char*       sh_name_base = elf_map + p_shstrtab->sh_offset;
-    Elf64_Shdr* p_dynsym     = NULL;
-    Elf64_Addr  base         = _get_base_64(ehdr, elf_map);
+    void*       elf_map = elf_file__addr(elf);
+    Elf64_Ehdr* ehdr    = elf_map;
+    Elf64_Addr  base    = _get_base_64(ehdr, elf_map);
 
     void*  bss_base = NULL;
     size_t bss_size = 0;
@@ -125,29 +134,30 @@ _py_proc__analyze_elf64(py_proc_t* self, void* elf_map, void* elf_base, proc_vm_
     if (base != UINT64_MAX) {
         log_d("ELF base @ %p", base);
 
-        for (Elf64_Off sh_off = ehdr->e_shoff; sh_off < elf_map_size; sh_off += ehdr->e_shentsize) {
-            p_shdr = (Elf64_Shdr*)(elf_map + sh_off);
-
-            if (p_shdr->sh_type == SHT_DYNSYM && strcmp(sh_name_base + p_shdr->sh_name, ".dynsym") == 0) {
-                p_dynsym = p_shdr;
-            } else if (strcmp(sh_name_base + p_shdr->sh_name, ".bss") == 0) {
-                bss_base = elf_base + (p_shdr->sh_addr - base);
-                bss_size = p_shdr->sh_size;
-            } else if (strcmp(sh_name_base + p_shdr->sh_name, ".PyRuntime") == 0) {
-                self->map.runtime.base = elf_base + (p_shdr->sh_addr - base);
-                self->map.runtime.size = p_shdr->sh_size;
-            }
+        elf_section_t* p_dynsym  = elf_file__section(elf, ".dynsym");
+        elf_section_t* p_bss     = elf_file__section(elf, ".bss");
+        elf_section_t* p_runtime = elf_file__section(elf, ".PyRuntime");
+        elf_section_t* p_rodata  = elf_file__section(elf, ".rodata");
+
+        if (isvalid(p_bss)) {
+            bss_base = elf_base + (p_bss->addr - base);
+            bss_size = p_bss->size;
         }
 
-        if (isvalid(p_dynsym)) {
-            if (p_dynsym->sh_offset != 0) {
-                Elf64_Shdr* p_strtabsh = (Elf64_Shdr*)(elf_map + ELF_SH_OFF(ehdr, p_dynsym->sh_link));
+        if (isvalid(p_runtime)) {
+            self->map.runtime.base = elf_base + (p_runtime->addr - base);
+            self->map.runtime.size = p_runtime->size;
+        }
+
+        if (isvalid(p_dynsym) && p_dynsym->type == SHT_DYNSYM && p_dynsym->link < elf->n_sections) {
+            if (p_dynsym->offset != 0) {
+                elf_section_t* p_strtabsh = elf->sections + p_dynsym->link;
 
                 // Search for dynamic symbols
-                for (Elf64_Off tab_off  = p_dynsym->sh_offset; tab_off < p_dynsym->sh_offset + p_dynsym->sh_size;
-                     tab_off           += p_dynsym->sh_entsize) {
+                for (Elf64_Off tab_off  = p_dynsym->offset; tab_off < p_dynsym->offset + p_dynsym->size;
+                     tab_off           += p_dynsym->entsize) {
                     Elf64_Sym* sym      = (Elf64_Sym*)(elf_map + tab_off);
-                    char*      sym_name = (char*)(elf_map + p_strtabsh->sh_offset + sym->st_name);
+                    char*      sym_name = (char*)(elf_map + p_strtabsh->offset + sym->st_name);
                     void*      value    = elf_base + (sym->st_value - base);
                     if ((symbols += _py_proc__check_sym(self, sym_name, value)) >= DYNSYM_COUNT) {
                         // We have found all the symbols. No need to look further
@@ -156,6 +166,15 @@ _py_proc__analyze_elf64(py_proc_t* self, void* elf_map, void* elf_base, proc_vm_
                 }
             }
         }
+
+        // The Py_Version symbol is more reliable, so we only look for the
+        // version string in the read-only data of binaries that do not export it.
+        if (isvalid(p_rodata) && p_rodata->type == SHT_PROGBITS && !isvalid(self->symbols[DYNSYM_HEX_VERSION])
+            && p_rodata->offset <= elf_file__size(elf) && p_rodata->size <= elf_file__size(elf) - p_rodata->offset) {
+            int version = find_version_string(elf_file__data(elf, p_rodata->offset), p_rodata->size);
+            if (version)
+                self->bin_version = version;
+        }
     }
 
     if (symbols < DYNSYM_MANDATORY) {
@@ -183,20 +202,12 @@ _get_base_32(Elf32_Ehdr* ehdr, void* elf_map) {
 } /* _get_base_32 */
 
 static int
-_py_proc__analyze_elf32(py_proc_t* self, void* elf_map, void* elf_base, proc_vm_map_block_t* bss) {
+_py_proc__analyze_elf32(py_proc_t* self, elf_file_t* elf, void* elf_base, proc_vm_map_block_t* bss) {
     register int symbols = 0;
 
-    Elf32_Ehdr* ehdr = elf_map;
-
-    // Section header must be read from binary as it is not loaded into memory
-    Elf32_Xword sht_size     = ehdr->e_shnum * ehdr->e_shentsize;
-    Elf32_Off   elf_map_size = ehdr->e_shoff + sht_size;
-    Elf32_Shdr* p_shdr;
-
-    Elf32_Shdr* p_shstrtab   = elf_map + ELF_SH_OFF(ehdr, ehdr->e_shstrndx);
-    char*       sh_name_base = elf_map + p_shstrtab->sh_offset;
-    Elf32_Shdr* p_dynsym     = NULL;
-    Elf32_Addr  base         = _get_base_32(ehdr, elf_map);
+    void*       elf_map = elf_file__addr(elf);
+    Elf32_Ehdr* ehdr    = elf_map;
+    Elf32_Addr  base    = _get_base_32(ehdr, elf_map);
 
     void*  bss_base = NULL;
     size_t bss_size = 0;
@@ -204,29 +215,30 @@ _py_proc__analyze_elf32(py_proc_t* self, void* elf_map, void* elf_base, proc_vm_
     if (base != UINT32_MAX) {
         log_d("ELF base @ %p", base);
 
-        for (Elf32_Off sh_off = ehdr->e_shoff; sh_off < elf_map_size; sh_off += ehdr->e_shentsize) {
-            p_shdr = (Elf32_Shdr*)(elf_map + sh_off);
-
-            if (p_shdr->sh_type == SHT_DYNSYM && strcmp(sh_name_base + p_shdr->sh_name, ".dynsym") == 0) {
-                p_dynsym = p_shdr;
-            } else if (strcmp(sh_name_base + p_shdr->sh_name, ".bss") == 0) {
-                bss_base = elf_base + (p_shdr->sh_addr - base);
-                bss_size = p_shdr->sh_size;
-            } else if (strcmp(sh_name_base + p_shdr->sh_name, ".PyRuntime") == 0) {
-                self->map.runtime.base = elf_base + (p_shdr->sh_addr - base);
-                self->map.runtime.size = p_shdr->sh_size;
-            }
+        elf_section_t* p_dynsym  = elf_file__section(elf, ".dynsym");
+        elf_section_t* p_bss     = elf_file__section(elf, ".bss");
+        elf_section_t* p_runtime = elf_file__section(elf, ".PyRuntime");
+        elf_section_t* p_rodata  = elf_file__section(elf, ".rodata");
+
+        if (isvalid(p_bss)) {
+            bss_base = elf_base + (p_bss->addr - base);
+            bss_size = p_bss->size;
+        }
+
+        if (isvalid(p_runtime)) {
+            self->map.runtime.base = elf_base + (p_runtime->addr - base);
+            self->map.runtime.size = p_runtime->size;
         }
 
-        if (isvalid(p_dynsym)) {
-            if (p_dynsym->sh_offset != 0) {
-                Elf32_Shdr* p_strtabsh = (Elf32_Shdr*)(elf_map + ELF_SH_OFF(ehdr, p_dynsym->sh_link));
+        if (isvalid(p_dynsym) && p_dynsym->type == SHT_DYNSYM && p_dynsym->link < elf->n_sections) {
+            if (p_dynsym->offset != 0) {
+                elf_section_t* p_strtabsh = elf->sections + p_dynsym->link;
 
                 // Search for dynamic symbols
-                for (Elf32_Off tab_off  = p_dynsym->sh_offset; tab_off < p_dynsym->sh_offset + p_dynsym->sh_size;
-                     tab_off           += p_dynsym->sh_entsize) {
+                for (Elf32_Off tab_off  = p_dynsym->offset; tab_off < p_dynsym->offset + p_dynsym->size;
+                     tab_off           += p_dynsym->entsize) {
                     Elf32_Sym* sym      = (Elf32_Sym*)(elf_map + tab_off);
-                    char*      sym_name = (char*)(elf_map + p_strtabsh->sh_offset + sym->st_name);
+                    char*      sym_name = (char*)(elf_map + p_strtabsh->offset + sym->st_name);
                     void*      value    = elf_base + (sym->st_value - base);
                     if ((symbols += _py_proc__check_sym(self, sym_name, value)) >= DYNSYM_COUNT) {
                         // We have found all the symbols. No need to look further
@@ -235,6 +247,15 @@ _py_proc__analyze_elf32(py_proc_t* self, void* elf_map, void* elf_base, proc_vm_
                 }
             }
         }
+
+        // The Py_Version symbol is more reliable, so we only look for the
+        // version string in the read-only data of binaries that do not export it.
+        if (isvalid(p_rodata) && p_rodata->type == SHT_PROGBITS && !isvalid(self->symbols[DYNSYM_HEX_VERSION])
+            && p_rodata->offset <= elf_file__size(elf) && p_rodata->size <= elf_file__size(elf) - p_rodata->offset) {
+            int version = find_version_string(elf_file__data(elf, p_rodata->offset), p_rodata->size);
+            if (version)
+                self->bin_version = version;
+        }
     }
 
     if (symbols < DYNSYM_MANDATORY) {
@@ -255,53 +276,23 @@ _py_proc__analyze_elf32(py_proc_t* self, void* elf_map, void* elf_base, proc_vm_
 
 // ----------------------------------------------------------------------------
 static int
-_elf_check(Elf64_Ehdr* ehdr) {
-    return (ehdr->e_shoff == 0 || ehdr->e_shnum < 2 || memcmp(ehdr->e_ident, ELFMAG, SELFMAG));
-}
-
-// ----------------------------------------------------------------------------
-static int
-_py_proc__analyze_elf(py_proc_t* self, char* path, void* elf_base, proc_vm_map_block_t* bss) {
-    cu_fd fd = open(path, O_RDONLY);
-    if (fd == -1) {
+_py_proc__analyze_elf(py_proc_t* self, elf_file_t* elf, void* elf_base, proc_vm_map_block_t* bss) {
+    if (!isvalid(elf)) {
         set_error(IO, "Cannot open binary file");
         FAIL;
     }
 
-    cu_map_t*   binary_map  = NULL;
-    size_t      binary_size = 0;
-    struct stat s;
-
-    if (fstat(fd, &s) == -1) { // GCOV_EXCL_START
-        set_error(IO, "Cannot determine size of binary file");
-        FAIL;
-    } // GCOV_EXCL_STOP
-
-    binary_size = s.st_size;
-
-    binary_map = map_new(fd, binary_size, MAP_PRIVATE);
-    if (!isvalid(binary_map)) { // GCOV_EXCL_START
-        set_error(IO, "Cannot map binary file to memory");
-        FAIL;
-    } // GCOV_EXCL_STOP
-
-    Elf64_Ehdr* ehdr = binary_map->addr;
     log_t("Analysing ELF");
 
-    if (fail(_elf_check(ehdr))) { // GCOV_EXCL_START
-        set_error(BINARY, "Bad ELF header");
-        FAIL;
-    } // GCOV_EXCL_STOP
-
     // Dispatch
-    switch (ehdr->e_ident[EI_CLASS]) {
+    switch (elf->elf_class) {
     case ELFCLASS64:
-        log_d("%s is 64-bit ELF", path);
-        return _py_proc__analyze_elf64(self, binary_map->addr, elf_base, bss);
+        log_d("%s is 64-bit ELF", elf->path);
+        return _py_proc__analyze_elf64(self, elf, elf_base, bss);
 
     case ELFCLASS32: // GCOV_EXCL_START
-        log_d("%s is 32-bit ELF", path);
-        return _py_proc__analyze_elf32(self, binary_map->addr, elf_base, bss);
+        log_d("%s is 32-bit ELF", elf->path);
+        return _py_proc__analyze_elf32(self, elf, elf_base, bss);
 
     default:
         set_error(BINARY, "Invalid ELF class");
@@ -316,11 +307,16 @@ _py_proc__inspect_vm_maps(py_proc_t* self) {
     struct vm_map*      map       = NULL;
     proc_vm_map_block_t bss;
 
-    cu_proc_map_t* proc_maps = proc_map_new(self->pid);
-    if (!isvalid(proc_maps)) {
+    if (!isvalid(self->extra->maps)) {
+        self->extra->maps = proc_maps_new(self->pid);
+        if (!isvalid(self->extra->maps))
+            FAIL;
+    } else if (fail(proc_maps__refresh(self->extra->maps))) {
         FAIL;
     }
 
+    proc_map_t* proc_maps = proc_maps__head(self->extra->maps);
+
     sfree(self->bin_path);
     sfree(self->lib_path);
 
@@ -339,7 +335,7 @@ _py_proc__inspect_vm_maps(py_proc_t* self) {
     if (fail(proc_exe_readlink(self->pid, pd->exe_path, sizeof(pd->exe_path)))) {
         // We cannot readlink the executable path so we take the first memory map
         PROC_MAP_ITER(proc_maps, m) {
-            if (isvalid(m->pathname)) {
+            if (isvalid(m->pathname) && m->pathname[0] == '/') {
                 strncpy(pd->exe_path, m->pathname, sizeof(pd->exe_path) - 1);
                 first_binary_map = m;
                 break;
@@ -362,10 +358,17 @@ _py_proc__inspect_vm_maps(py_proc_t* self) {
     if (!isvalid(map->path)) {
         FAIL; // GCOV_EXCL_LINE
     }
-    map->file_size   = _file_size(map->path);
+    // Open the new binaries before releasing the old ones so that we can reuse
+    // the existing mappings if nothing has changed.
+    elf_file_t* bin_elf = elf_file_open(map->path);
+    elf_file_t* lib_elf = NULL;
+    elf_file__close(self->extra->bin_elf);
+    self->extra->bin_elf = bin_elf;
+
+    map->file_size   = isvalid(bin_elf) ? (ssize_t)elf_file__size(bin_elf) : _file_size(map->path);
     map->base        = first_binary_map->address;
     map->size        = first_binary_map->size;
-    map->has_symbols = success(_py_proc__analyze_elf(self, map->path, map->base, &bss));
+    map->has_symbols = success(_py_proc__analyze_elf(self, bin_elf, map->base, &bss));
     if (map->has_symbols) {
         map->bss_base = bss.base;
         map->bss_size = bss.size;
@@ -402,7 +405,13 @@ _py_proc__inspect_vm_maps(py_proc_t* self) {
 
     proc_map_t* first_lib_map = proc_map__first_submatch(proc_maps, LIB_NEEDLE);
     if (isvalid(first_lib_map)) {
-        if (success(_py_proc__analyze_elf(self, first_lib_map->pathname, first_lib_map->address, &bss))) {
+        lib_elf = elf_file_open(first_lib_map->pathname);
+    }
+    elf_file__close(self->extra->lib_elf);
+    self->extra->lib_elf = lib_elf;
+
+    if (isvalid(first_lib_map)) {
+        if (success(_py_proc__analyze_elf(self, lib_elf, first_lib_map->address, &bss))) {
             // The library binary has symbols
             map = &(pd->maps[MAP_LIBSYM]);
 
@@ -410,7 +419,7 @@ _py_proc__inspect_vm_maps(py_proc_t* self) {
             if (!isvalid(map->path)) {
                 FAIL; // GCOV_EXCL_LINE
             }
-            map->file_size   = _file_size(map->path);
+            map->file_size   = elf_file__size(lib_elf);
             map->base        = first_lib_map->address;
             map->size        = first_lib_map->size;
             map->has_symbols = true;
@@ -422,8 +431,8 @@ _py_proc__inspect_vm_maps(py_proc_t* self) {
             // We look for something matching "libpythonX.Y"
             PROC_MAP_ITER(first_lib_map, m) {
                 unsigned int v;
-                char*        needle = strstr(m->pathname, LIB_NEEDLE);
-                if (sscanf(needle, "libpython%u.%u", &v, &v) == 2) {
+                char*        needle = isvalid(m->pathname) ? strstr(m->pathname, LIB_NEEDLE) : NULL;
+                if (isvalid(needle) && sscanf(needle, "libpython%u.%u", &v, &v) == 2) {
                     map = &(pd->maps[MAP_LIBNEEDLE]);
 
                     map->path = proc_root(self->pid, m->pathname);
@@ -500,83 +509,112 @@ _py_proc__inspect_vm_maps(py_proc_t* self) {
 // ----------------------------------------------------------------------------
 static ssize_t
 _py_proc__get_resident_memory(py_proc_t* self) {
-    cu_FILE* statm = fopen(self->extra->statm_file, "rb");
-    if (statm == NULL) { // GCOV_EXCL_START
-        set_error(IO, "Cannot open statm file");
+    // The statm file is kept open and read from the start every time, as this
+    // is done on every sample in memory mode.
+    ssize_t resident = proc_statm_read_resident(self->extra->statm_fd);
+    if (resident < 0) { // GCOV_EXCL_START
         FAIL_INT;
     } // GCOV_EXCL_STOP
 
-    ssize_t size, resident;
-    if (fscanf(statm, "%zd %zd", &size, &resident) != 2) { // GCOV_EXCL_START
-        set_error(OS, "Failed to parse statm file");
-        FAIL_INT; // cppcheck-suppress [resourceLeak]
-    } // GCOV_EXCL_STOP
-
-    return resident * self->extra->page_size; // cppcheck-suppress [resourceLeak]
+    return resident * self->extra->page_size;
 } /* _py_proc__get_resident_memory */
 
 #ifdef NATIVE
 // ----------------------------------------------------------------------------
-#define RANGES_MAX 256
-
-char        pathname[1024];
-char        prevpathname[1024];
-vm_range_t* ranges[RANGES_MAX];
-
 static int
 _py_proc__get_vm_maps(py_proc_t* self) {
-    vm_range_tree_t* tree  = NULL;
-    hash_table_t*    table = NULL;
-    cu_proc_map_t*   maps  = NULL;
-
-    if (pargs.where) {
-        tree  = vm_range_tree_new();
-        table = hash_table_new(RANGES_MAX);
+    if (!isvalid(self->extra->maps)) {
+        self->extra->maps = proc_maps_new(self->pid);
+        if (!isvalid(self->extra->maps))
+            FAIL; // GCOV_EXCL_LINE
+    } else if (fail(proc_maps__refresh(self->extra->maps))) {
+        FAIL; // GCOV_EXCL_LINE
+    }
 
-        vm_range_tree__destroy(self->maps_tree);
-        hash_table__destroy(self->base_table);
+    if (self->extra->vm_maps_generation == self->extra->maps->generation) {
+        log_d("VM maps unchanged");
+        SUCCESS;
+    }
+    self->extra->vm_maps_generation = self->extra->maps->generation;
+
+    // The generation only moves when the content of the maps file has actually
+    // changed, in which case any cached unwind information might refer to
+    // objects that are no longer mapped.
+    if (isvalid(self->unwind.as))
+        unw_flush_cache(self->unwind.as, 0, 0);
+
+    proc_map_t* maps = proc_maps__head(self->extra->maps);
+
+    if (!(pargs.where || pargs.resolve)) {
+        // We print the maps too so that frame locations can be resolved later
+        // and we can use the CPU more efficiently to collect samples. We still
+        // need the table below to name the native frames.
+        PROC_MAP_ITER(maps, m) {
+            if (isvalid(m->pathname) && m->pathname[0] != '[')
+                event_handler__emit_metadata(
+                    "map", "%zx-%zx %s", (addr_t)m->address, ((addr_t)m->address) + m->size, m->pathname
+                );
+        }
+    }
 
-        self->maps_tree  = tree;
-        self->base_table = table;
+    if (!isvalid(self->vm_ranges)) {
+        self->vm_ranges = vm_range_table_new();
+        if (!isvalid(self->vm_ranges))
+            FAIL; // GCOV_EXCL_LINE
     }
+    vm_range_table_t* table = self->vm_ranges;
 
-    maps = proc_map_new(self->pid);
-    if (!isvalid(maps))
-        FAIL; // GCOV_EXCL_LINE
+    // Maps the objects seen so far to their load address.
+    hash_table_t* bases = hash_table_new((self->extra->maps->count * 4 / 3) | 1);
+    if (!isvalid(bases)) { // GCOV_EXCL_START
+        set_error(MALLOC, "Cannot allocate memory for VM range bases");
+        FAIL;
+    } // GCOV_EXCL_STOP
 
-    log_d("Rebuilding vm ranges tree");
+    log_d("Rebuilding vm ranges table");
 
-    int nrange = 0;
-    PROC_MAP_ITER(maps, m) {
-        if (nrange >= RANGES_MAX) { // GCOV_EXCL_START
-            log_e("Too many ranges");
-            break;
-        } // GCOV_EXCL_STOP
+    vm_range_table__clear(table);
 
+    // Pseudo-maps are added too, so that the frames in them, e.g. in the vDSO,
+    // do not look like they belong to objects that have just been mapped.
+    vm_range_t* last = NULL;
+    PROC_MAP_ITER(maps, m) {
         if (!isvalid(m->pathname))
             continue;
 
-        if (pargs.where) {
-            if (strcmp(m->pathname, prevpathname)) {
-                ranges[nrange++]
-                    = vm_range_new((addr_t)m->address, ((addr_t)m->address) + m->size, strdup(m->pathname));
-                key_dt key = string__hash(m->pathname);
-                if (!isvalid(hash_table__get(table, key)))
-                    hash_table__set(table, key, (value_t)m->address);
-                strcpy(prevpathname, m->pathname);
-            } else
-                ranges[nrange - 1]->hi = ((addr_t)m->address) + m->size;
-        } else {
-            // We print the maps instead so that we can resolve them later and use
-            // the CPU more efficiently to collect samples.
-            event_handler__emit_metadata(
-                "map", "%zx-%zx %s", (addr_t)m->address, ((addr_t)m->address) + m->size, m->pathname
-            );
+        addr_t lo = (addr_t)m->address;
+        addr_t hi = lo + m->size;
+
+        if (isvalid(last) && strcmp(m->pathname, last->name) == 0) {
+            last->hi = hi;
+            continue;
+        }
+
+        key_dt key  = string__hash(m->pathname);
+        addr_t base = (addr_t)hash_table__get(bases, key);
+        if (base == 0) {
+            base = lo;
+            hash_table__set(bases, key, (value_t)base);
         }
+
+        char* name = strdup(m->pathname);
+        if (!isvalid(name)) { // GCOV_EXCL_START
+            set_error(MALLOC, "Cannot allocate memory for VM range name");
+            hash_table__destroy(bases);
+            FAIL;
+        } // GCOV_EXCL_STOP
+
+        last = vm_range_table__add(table, lo, hi, base, name);
+        if (!isvalid(last)) { // GCOV_EXCL_START
+            free(name);
+            hash_table__destroy(bases);
+            FAIL;
+        } // GCOV_EXCL_STOP
     }
 
-    for (int i = 0; i < nrange; i++)
-        vm_range_tree__add(tree, (vm_range_t*)ranges[i]);
+    hash_table__destroy(bases);
+
+    log_d("VM ranges table has %zu ranges", table->count);
 
     SUCCESS;
 } /* _py_proc__get_vm_maps */
@@ -606,7 +644,12 @@ _py_proc__init(py_proc_t* self) {
     self->extra->page_size = get_page_size();
     log_d("Page size: %u", self->extra->page_size);
 
-    sprintf(self->extra->statm_file, "/proc/%d/statm", self->pid);
+    if (self->extra->statm_fd == -1) {
+        char statm_file[32];
+        sprintf(statm_file, "/proc/%d/statm", self->pid);
+
+        self->extra->statm_fd = open(statm_file, O_RDONLY);
+    }
 
     self->last_resident_memory = _py_proc__get_resident_memory(self);
 
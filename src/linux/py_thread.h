@@ -25,6 +25,7 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <unistd.h>
 
 #include "common.h"
@@ -33,30 +34,135 @@
 #include "../py_thread.h"
 #include "../resources.h"
 
+#define STAT_BUFFER_SIZE   2048
+#define STAT_FD_MAX_BUDGET 4096
+
+// The stat files of the threads are kept open and read again from the start
+// on every sample. A TID is looked up in a table of open files, bounded by a
+// budget of file descriptors. When the budget is exhausted, the least recently
+// used file is closed to make room, which also takes care of threads that
+// have gone away without us noticing.
+typedef struct {
+    pid_t    tid;
+    int      fd;
+    uint64_t used;
+} stat_file_t;
+
+static lookup_t*    _stat_slots  = NULL; // The slot of each TID, plus one
+static stat_file_t* _stat_files  = NULL;
+static unsigned int _stat_budget = 0;
+static unsigned int _stat_count  = 0;
+static uint64_t     _stat_clock  = 0;
+
 // ----------------------------------------------------------------------------
-bool
-py_thread__is_idle(py_thread_t* self) {
-#ifdef NATIVE
-    size_t index  = self->tid >> 3;
-    int    offset = self->tid & 7;
+static inline void
+_stat_files__evict(stat_file_t* file) {
+    close(file->fd);
+    lookup__del(_stat_slots, (key_dt)file->tid);
 
-    return _tids_idle[index] & (1 << offset);
-#else
-    char file_name[64];
-    char buffer[2048] = "";
+    // Keep the table compact by moving the last file into the free slot.
+    stat_file_t* last = _stat_files + --_stat_count;
+    if (file != last) {
+        *file = *last;
+        lookup__set(_stat_slots, (key_dt)file->tid, (value_t)(uintptr_t)(file - _stat_files + 1));
+    }
+}
 
+// ----------------------------------------------------------------------------
+static inline stat_file_t*
+_stat_files__get(py_thread_t* self) {
+    uintptr_t slot = (uintptr_t)lookup__get(_stat_slots, (key_dt)self->tid);
+    if (slot) {
+        stat_file_t* file = _stat_files + slot - 1;
+        file->used        = ++_stat_clock;
+        return file;
+    }
+
+    char file_name[64];
     sprintf(file_name, "/proc/%d/task/%" PRIuPTR "/stat", self->proc->pid, self->tid);
 
-    cu_fd fd = open(file_name, O_RDONLY);
-    if (fd == -1) { // GCOV_EXCL_START
+    int fd = open(file_name, O_RDONLY);
+    if (fd == -1) // GCOV_EXCL_LINE
+        return NULL;
+
+    if (_stat_count == _stat_budget) {
+        stat_file_t* lru = _stat_files;
+        for (stat_file_t* file = _stat_files + 1; file < _stat_files + _stat_count; file++) {
+            if (file->used < lru->used)
+                lru = file;
+        }
+        _stat_files__evict(lru);
+    }
+
+    stat_file_t* file = _stat_files + _stat_count++;
+
+    file->tid  = self->tid;
+    file->fd   = fd;
+    file->used = ++_stat_clock;
+    lookup__set(_stat_slots, (key_dt)self->tid, (value_t)(uintptr_t)_stat_count);
+
+    return file;
+}
+
+// ----------------------------------------------------------------------------
+static inline int
+stat_files_allocate(void) {
+    // Leave plenty of file descriptors for everything else.
+    struct rlimit limit;
+    _stat_budget = STAT_FD_MAX_BUDGET;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur / 2 < _stat_budget)
+        _stat_budget = limit.rlim_cur / 2;
+    if (_stat_budget == 0) // GCOV_EXCL_LINE
+        _stat_budget = 1;  // GCOV_EXCL_LINE
+
+    _stat_slots = lookup_new(64);
+    _stat_files = (stat_file_t*)calloc(_stat_budget, sizeof(stat_file_t));
+    if (!isvalid(_stat_slots) || !isvalid(_stat_files)) { // GCOV_EXCL_START
+        lookup__destroy(_stat_slots);
+        _stat_slots = NULL;
+        sfree(_stat_files);
+        set_error(MALLOC, "Failed to allocate thread stat file table");
+        FAIL;
+    } // GCOV_EXCL_STOP
+
+    SUCCESS;
+}
+
+// ----------------------------------------------------------------------------
+static inline void
+stat_files_free(void) {
+    if (isvalid(_stat_files)) {
+        for (unsigned int i = 0; i < _stat_count; i++)
+            close(_stat_files[i].fd);
+    }
+    _stat_count = 0;
+
+    lookup__destroy(_stat_slots);
+    _stat_slots = NULL;
+    sfree(_stat_files);
+}
+
+// ----------------------------------------------------------------------------
+// Read the state of the thread from its stat file.
+static inline bool
+_py_thread__stat_is_idle(py_thread_t* self) {
+    char buffer[STAT_BUFFER_SIZE];
+
+    stat_file_t* file = _stat_files__get(self);
+    if (!isvalid(file)) { // GCOV_EXCL_START
         set_error(IO, "Cannot open thread stat file");
         FAIL_BOOL;
     } // GCOV_EXCL_STOP
 
-    if (read(fd, buffer, 2047) == 0) { // GCOV_EXCL_START
+    ssize_t size = pread(file->fd, buffer, sizeof(buffer) - 1, 0);
+    if (size <= 0) { // GCOV_EXCL_START
+        // The thread is gone, or its TID has been reused. In the latter case
+        // the file is reopened the next time.
+        _stat_files__evict(file);
         set_error(IO, "Cannot read thread stat file");
         FAIL_BOOL;
     } // GCOV_EXCL_STOP
+    buffer[size] = '\0';
 
     char* p = strchr(buffer, ')'); // GCOV_EXCL_START
     if (!isvalid(p)) {
@@ -69,5 +175,63 @@ py_thread__is_idle(py_thread_t* self) {
         p++; // GCOV_EXCL_LINE
 
     return (*p != 'R');
+}
+
+// ----------------------------------------------------------------------------
+// Replace the pthread_t of the thread, which is what thread states record
+// before 3.11, with its TID. The TID is read from the pthread structure and
+// cached by thread state. A thread state never moves to another thread, so
+// the cached TID is good for as long as the thread state has the same unique
+// ID and pthread_t.
+static inline int
+_py_thread__resolve_pthread_tid(py_thread_t* self, uint64_t id) {
+    proc_extra_info* extra = self->proc->extra;
+    pthread_tid_t*   entry = lru_cache__maybe_hit(extra->pthread_tid_cache, (key_dt)self->addr);
+
+    if (isvalid(entry) && entry->id == id && entry->thread_id == self->tid) {
+        self->tid = entry->tid;
+        SUCCESS;
+    }
+
+    // We only need the TID field, rather than the whole structure.
+    int       o   = extra->pthread_tid_offset;
+    uintptr_t tid = 0;
+    if (o > 0) {
+        if (fail(copy_datatype(self->proc->ref, (uintptr_t*)self->tid + o, tid)))
+            FAIL;
+    } else { // GCOV_EXCL_START
+        pid_t field;
+        if (fail(copy_datatype(self->proc->ref, (pid_t*)self->tid - o, field)))
+            FAIL;
+        tid = field;
+    } // GCOV_EXCL_STOP
+
+    if (tid != 0 && tid < max_pid) {
+        if (!isvalid(entry)) {
+            entry = (pthread_tid_t*)malloc(sizeof(pthread_tid_t));
+            if (isvalid(entry))
+                lru_cache__store(extra->pthread_tid_cache, (key_dt)self->addr, entry);
+        }
+        if (isvalid(entry)) {
+            entry->id        = id;
+            entry->thread_id = self->tid;
+            entry->tid       = tid;
+        }
+    }
+
+    self->tid = tid;
+
+    SUCCESS;
+}
+
+// ----------------------------------------------------------------------------
+bool
+py_thread__is_idle(py_thread_t* self) {
+#ifdef NATIVE
+    tid_state_t* state = lookup__get(_tid_states, (key_dt)self->tid);
+
+    return isvalid(state) && state->is_idle;
+#else
+    return _py_thread__stat_is_idle(self);
 #endif
 }
@@ -0,0 +1,445 @@
+// This file is part of "austin" which is released under GPL.
+//
+// See file LICENCE or go to http://www.gnu.org/licenses/ for full license
+// details.
+//
+// Austin is a Python frame stack sampler for CPython.
+//
+// Copyright (c) 2018-2025 Gabriele N. Tornetta <phoenix1987@gmail.com>.
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Function symbol indices for native modules. Each index is a sorted array of
+// the function symbols found in the .symtab and .dynsym sections of a binary,
+// so that native frames can be named with a local binary search rather than
+// with a symbol lookup through libunwind. Indices are shared by all the
+// processes that map the same binary, as identified by its build ID. Binaries
+// are looked up by their path first, so that they are read only once.
+
+#pragma once
+
+#include <elf.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "../argparse.h"
+#include "../cache.h"
+#include "../error.h"
+#include "../hints.h"
+#include "../logging.h"
+#include "../py_string.h"
+#include "common.h"
+#include "elf-file.h"
+
+typedef struct {
+    uint64_t start;
+    uint64_t size;
+    uint32_t name;        // Offset of the name in the name pool
+    uint8_t  frame_setup; // Length of the prologue that sets up the frame pointer, if any
+} symbol_t;
+
+typedef struct _symbol_index {
+    char*     id;           // The build ID, or the path if the binary has none
+    uint64_t  load_address; // The virtual address the binary expects to be loaded at
+    symbol_t* symbols;
+    size_t    count;
+    size_t    capacity;
+    char*     names;
+    size_t    names_size;
+    size_t    names_capacity;
+
+    struct _symbol_index* next; // Next index with the same ID hash
+} symbol_index_t;
+
+// The index of the binary found at a path, as seen through the root of the
+// process that maps it.
+typedef struct _symbol_index_path {
+    char*           path;
+    symbol_index_t* index;
+
+    struct _symbol_index_path* next; // Next path with the same hash
+} symbol_index_path_t;
+
+#define symbol_index__name(self, symbol) ((self)->names + (symbol)->name)
+
+// Returned for the binaries that cannot be indexed, so that we do not attempt
+// to index them again.
+static symbol_index_t _no_symbol_index = {0};
+
+static lookup_t* _symbol_indices     = NULL; // By build ID
+static lookup_t* _symbol_index_paths = NULL; // By root path
+
+// ----------------------------------------------------------------------------
+static inline void
+_symbol_index__destroy(symbol_index_t* self) {
+    if (!isvalid(self) || self == &_no_symbol_index)
+        return;
+
+    sfree(self->id);
+    sfree(self->symbols);
+    sfree(self->names);
+
+    free(self);
+}
+
+// ----------------------------------------------------------------------------
+// Get the length of the standard frame pointer set-up sequence at the given
+// offset of the ELF file, or 0 if the function does not begin with one.
+static inline uint8_t
+_elf_file__frame_setup(elf_file_t* elf, uint64_t offset) {
+#if defined __x86_64__
+    static const unsigned char endbr64[] = {0xf3, 0x0f, 0x1e, 0xfa};
+    static const unsigned char setup[]   = {0x55, 0x48, 0x89, 0xe5}; // push %rbp; mov %rsp,%rbp
+
+    if (offset + sizeof(endbr64) + sizeof(setup) > elf_file__size(elf))
+        return 0;
+
+    unsigned char* code = elf_file__data(elf, offset);
+    uint8_t        len  = 0;
+    if (memcmp(code, endbr64, sizeof(endbr64)) == 0)
+        len += sizeof(endbr64);
+
+    return memcmp(code + len, setup, sizeof(setup)) == 0 ? len + sizeof(setup) : 0;
+#else
+    return 0;
+#endif
+}
+
+// ----------------------------------------------------------------------------
+static inline int
+_symbol_index__add(symbol_index_t* self, uint64_t start, uint64_t size, const char* name, uint8_t frame_setup) {
+    size_t len = strlen(name) + 1;
+
+    if (self->count == self->capacity) {
+        size_t    capacity = self->capacity ? self->capacity << 1 : 256;
+        symbol_t* symbols  = (symbol_t*)realloc(self->symbols, capacity * sizeof(symbol_t));
+        if (!isvalid(symbols)) { // GCOV_EXCL_START
+            set_error(MALLOC, "Cannot allocate memory for symbol index");
+            FAIL;
+        } // GCOV_EXCL_STOP
+        self->symbols  = symbols;
+        self->capacity = capacity;
+    }
+
+    if (self->names_size + len > self->names_capacity) {
+        size_t capacity = self->names_capacity ? self->names_capacity << 1 : 4096;
+        while (capacity < self->names_size + len)
+            capacity <<= 1;
+        if (capacity > UINT32_MAX) { // GCOV_EXCL_START
+            set_error(BINARY, "Symbol name pool too large");
+            FAIL;
+        } // GCOV_EXCL_STOP
+        char* names = (char*)realloc(self->names, capacity);
+        if (!isvalid(names)) { // GCOV_EXCL_START
+            set_error(MALLOC, "Cannot allocate memory for symbol names");
+            FAIL;
+        } // GCOV_EXCL_STOP
+        self->names          = names;
+        self->names_capacity = capacity;
+    }
+
+    symbol_t* symbol = self->symbols + self->count++;
+
+    symbol->start       = start;
+    symbol->size        = size;
+    symbol->name        = (uint32_t)self->names_size;
+    symbol->frame_setup = frame_setup;
+
+    memcpy(self->names + self->names_size, name, len);
+    self->names_size += len;
+
+    SUCCESS;
+}
+
+// ----------------------------------------------------------------------------
+static int
+_symbol__compare(const void* a, const void* b) {
+    const symbol_t* x = (const symbol_t*)a;
+    const symbol_t* y = (const symbol_t*)b;
+
+    if (x->start != y->start)
+        return x->start < y->start ? -1 : 1;
+
+    // Prefer sized symbols for aliases of the same function.
+    return (x->size < y->size) - (x->size > y->size);
+}
+
+// ----------------------------------------------------------------------------
+#define _SYMBOL_INDEX_LOAD(self, elf, bits)                                                                     \
+    {                                                                                                           \
+        Elf##bits##_Ehdr* ehdr = (Elf##bits##_Ehdr*)elf_file__addr(elf);                                       \
+        if (ehdr->e_phoff + (uint64_t)ehdr->e_phnum * ehdr->e_phentsize > elf_file__size(elf)) {                \
+            set_error(BINARY, "Bad ELF program header table");                                                  \
+            FAIL;                                                                                               \
+        }                                                                                                       \
+        Elf##bits##_Phdr* text = NULL;                                                                          \
+        for (size_t i = 0, loads = 0; i < ehdr->e_phnum; i++) {                                                 \
+            Elf##bits##_Phdr* phdr = elf_file__data(elf, ehdr->e_phoff + i * ehdr->e_phentsize);                \
+            if (phdr->p_type != PT_LOAD)                                                                        \
+                continue;                                                                                       \
+            if (loads++ == 0)                                                                                   \
+                self->load_address = phdr->p_vaddr - phdr->p_offset;                                            \
+            if ((phdr->p_flags & PF_X) && !isvalid(text))                                                       \
+                text = phdr;                                                                                    \
+        }                                                                                                       \
+        for (size_t i = 0; i < elf->n_sections; i++) {                                                         \
+            elf_section_t* section = elf->sections + i;                                                         \
+            if ((section->type != SHT_SYMTAB && section->type != SHT_DYNSYM)                                    \
+                || section->entsize != sizeof(Elf##bits##_Sym) || section->link >= elf->n_sections              \
+                || section->offset + section->size > elf_file__size(elf))                                       \
+                continue;                                                                                       \
+            elf_section_t* strtab = elf->sections + section->link;                                              \
+            if (strtab->offset + strtab->size > elf_file__size(elf))                                            \
+                continue;                                                                                       \
+            char* strings = elf_file__data(elf, strtab->offset);                                                \
+            for (Elf##bits##_Sym* sym = elf_file__data(elf, section->offset),                                   \
+                                  *end = elf_file__data(elf, section->offset + section->size);                  \
+                 sym < end; sym++) {                                                                            \
+                int type = ELF##bits##_ST_TYPE(sym->st_info);                                                   \
+                if ((type != STT_FUNC && type != STT_GNU_IFUNC) || sym->st_shndx == SHN_UNDEF                   \
+                    || sym->st_value == 0 || sym->st_name == 0 || sym->st_name >= strtab->size                  \
+                    || memchr(strings + sym->st_name, '\0', strtab->size - sym->st_name) == NULL)               \
+                    continue;                                                                                   \
+                uint8_t frame_setup = 0;                                                                        \
+                if (bits == 64 && pargs.frame_pointers && isvalid(text) && sym->st_value >= text->p_vaddr       \
+                    && sym->st_value - text->p_vaddr < text->p_filesz)                                          \
+                    frame_setup = _elf_file__frame_setup(elf, text->p_offset + sym->st_value - text->p_vaddr);  \
+                if (fail(_symbol_index__add(                                                                    \
+                        self, sym->st_value, sym->st_size, strings + sym->st_name, frame_setup                  \
+                    )))                                                                                         \
+                    FAIL;                                                                                       \
+            }                                                                                                   \
+        }                                                                                                       \
+    }
+
+static inline int
+_symbol_index__load(symbol_index_t* self, elf_file_t* elf) {
+    switch (elf->elf_class) {
+    case ELFCLASS64:
+        _SYMBOL_INDEX_LOAD(self, elf, 64);
+        break;
+
+    case ELFCLASS32: // GCOV_EXCL_START
+        _SYMBOL_INDEX_LOAD(self, elf, 32);
+        break;
+
+    default:
+        set_error(BINARY, "Invalid ELF class");
+        FAIL;
+    } // GCOV_EXCL_STOP
+
+    if (self->count == 0)
+        SUCCESS;
+
+    // Sort by address and drop the aliases, which would be shadowed anyway.
+    qsort(self->symbols, self->count, sizeof(symbol_t), _symbol__compare);
+
+    size_t n = 1;
+    for (size_t i = 1; i < self->count; i++) {
+        if (self->symbols[i].start != self->symbols[n - 1].start)
+            self->symbols[n++] = self->symbols[i];
+    }
+    self->count = n;
+
+    SUCCESS;
+}
+
+// ----------------------------------------------------------------------------
+// Render the build ID of the binary as a hex string, if it has one.
+static inline char*
+_elf_file__build_id(elf_file_t* elf) {
+    elf_section_t* section = elf_file__section(elf, ".note.gnu.build-id");
+    if (!isvalid(section) || section->size < sizeof(Elf64_Nhdr)
+        || section->offset + section->size > elf_file__size(elf))
+        return NULL;
+
+    // The note header has the same layout for both ELF classes.
+    Elf64_Nhdr* note = elf_file__data(elf, section->offset);
+    size_t      desc = sizeof(Elf64_Nhdr) + ((note->n_namesz + 3) & ~3);
+    if (note->n_type != NT_GNU_BUILD_ID || note->n_descsz == 0 || desc + note->n_descsz > section->size)
+        return NULL;
+
+    char* id = (char*)malloc(note->n_descsz * 2 + 1);
+    if (!isvalid(id)) // GCOV_EXCL_LINE
+        return NULL;  // GCOV_EXCL_LINE
+
+    unsigned char* bytes = (unsigned char*)note + desc;
+    for (size_t i = 0; i < note->n_descsz; i++)
+        sprintf(id + (i << 1), "%02x", bytes[i]);
+
+    return id;
+}
+
+// ----------------------------------------------------------------------------
+// Read the binary at the given path and index its function symbols, unless a
+// binary with the same build ID has already been indexed.
+static inline symbol_index_t*
+_symbol_index__open(char* path) {
+    cu_elf_file_t* elf = elf_file_open(path);
+    if (!isvalid(elf)) {
+        log_d("Cannot open %s for symbol indexing", path);
+        return &_no_symbol_index;
+    }
+
+    char* id = _elf_file__build_id(elf);
+    if (!isvalid(id))
+        id = strdup(path);
+    if (!isvalid(id))             // GCOV_EXCL_LINE
+        return &_no_symbol_index; // GCOV_EXCL_LINE
+
+    key_dt          key  = string__hash(id);
+    symbol_index_t* head = (symbol_index_t*)lookup__get(_symbol_indices, key);
+    for (symbol_index_t* index = head; isvalid(index); index = index->next) {
+        if (strcmp(index->id, id) == 0) {
+            free(id);
+            return index;
+        }
+    }
+
+    symbol_index_t* index = (symbol_index_t*)calloc(1, sizeof(symbol_index_t));
+    if (!isvalid(index)) { // GCOV_EXCL_START
+        free(id);
+        return &_no_symbol_index;
+    } // GCOV_EXCL_STOP
+    index->id = id;
+
+    if (fail(_symbol_index__load(index, elf))) {
+        log_d("Cannot index the symbols of %s", path);
+        _symbol_index__destroy(index);
+        return &_no_symbol_index;
+    }
+
+    log_d("Indexed %zu function symbols for %s [%s]", index->count, path, id);
+
+    // Indices are never replaced, as VM ranges might still refer to them, so
+    // the IDs with the same hash are chained instead.
+    index->next = head;
+    lookup__set(_symbol_indices, key, index);
+
+    return index;
+}
+
+// ----------------------------------------------------------------------------
+/**
+ * Get the function symbol index of a binary mapped by a process. The binary
+ * is read locally, through the root of the process, and the index is built on
+ * the first request only. Binaries that cannot be indexed are remembered too.
+ *
+ * @param pid   the process that maps the binary
+ * @param path  the path of the binary, as it appears in the process maps
+ *
+ * @return a valid reference to a (possibly empty) symbol index.
+ */
+static inline symbol_index_t*
+symbol_index__get(pid_t pid, char* path) {
+    if (!isvalid(_symbol_indices)) {
+        _symbol_indices     = lookup_new(32);
+        _symbol_index_paths = lookup_new(32);
+        if (!isvalid(_symbol_indices) || !isvalid(_symbol_index_paths)) // GCOV_EXCL_LINE
+            return &_no_symbol_index;                                   // GCOV_EXCL_LINE
+    }
+
+    cu_char* root_path = proc_root(pid, path);
+    if (!isvalid(root_path))
+        return &_no_symbol_index;
+
+    key_dt               key  = string__hash(root_path);
+    symbol_index_path_t* head = (symbol_index_path_t*)lookup__get(_symbol_index_paths, key);
+    for (symbol_index_path_t* entry = head; isvalid(entry); entry = entry->next) {
+        if (strcmp(entry->path, root_path) == 0)
+            return entry->index;
+    }
+
+    symbol_index_t* index = _symbol_index__open(root_path);
+
+    symbol_index_path_t* entry = (symbol_index_path_t*)malloc(sizeof(symbol_index_path_t));
+    if (!isvalid(entry)) // GCOV_EXCL_LINE
+        return index;    // GCOV_EXCL_LINE
+
+    entry->path  = strdup(root_path);
+    entry->index = index;
+    entry->next  = head;
+    if (!isvalid(entry->path)) { // GCOV_EXCL_START
+        free(entry);
+        return index;
+    } // GCOV_EXCL_STOP
+
+    lookup__set(_symbol_index_paths, key, entry);
+
+    return index;
+}
+
+// ----------------------------------------------------------------------------
+/**
+ * Find the function symbol that contains the given address. Symbols without a
+ * size only match their own address, as we cannot tell where they end.
+ *
+ * @param self  the symbol index
+ * @param addr  the virtual address, as expected by the binary
+ *
+ * @return a valid reference to a symbol, NULL otherwise.
+ */
+static inline symbol_t*
+symbol_index__find(symbol_index_t* self, uint64_t addr) {
+    size_t n = self->count;
+    if (n == 0)
+        return NULL;
+
+    // Branchless binary search for the last symbol with start <= addr.
+    symbol_t* base = self->symbols;
+    while (n > 1) {
+        size_t half  = n >> 1;
+        base        += (base[half].start <= addr) * half;
+        n           -= half;
+    }
+
+    if (base->start > addr || (base->size > 0 ? addr - base->start >= base->size : addr != base->start))
+        return NULL;
+
+    return base;
+}
+
+// ----------------------------------------------------------------------------
+static inline void
+symbol_indices__destroy(void) {
+    if (isvalid(_symbol_index_paths)) {
+        hash_table__iter_start(_symbol_index_paths->hash, symbol_index_path_t*, head) {
+            for (symbol_index_path_t *entry = head, *next; isvalid(entry); entry = next) {
+                next = entry->next;
+                free(entry->path);
+                free(entry);
+            }
+        }
+        hash_table__iter_stop(_symbol_index_paths->hash);
+
+        lookup__destroy(_symbol_index_paths);
+        _symbol_index_paths = NULL;
+    }
+
+    if (isvalid(_symbol_indices)) {
+        hash_table__iter_start(_symbol_indices->hash, symbol_index_t*, head) {
+            for (symbol_index_t *index = head, *next; isvalid(index); index = next) {
+                next = index->next;
+                _symbol_index__destroy(index);
+            }
+        }
+        hash_table__iter_stop(_symbol_indices->hash);
+
+        lookup__destroy(_symbol_indices);
+        _symbol_indices = NULL;
+    }
+}
@@ -0,0 +1,451 @@
+// This file is part of "austin" which is released under GPL.
+//
+// See file LICENCE or go to http://www.gnu.org/licenses/ for full license
+// details.
+//
+// Austin is a Python frame stack sampler for CPython.
+//
+// Copyright (c) 2018-2025 Gabriele N. Tornetta <phoenix1987@gmail.com>.
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// Background symbolisation of native frames. Resolving source locations with
+// BFD is far too slow to be done while sampling, so the sampler emits
+// provisional frames (module and offset) and queues them up here. A worker
+// thread resolves them, and the sampler drains the results of the process it
+// is sampling between samples, to emit updated definitions for the same frame
+// keys. All the output is produced by the sampler thread, so the MOJO stream
+// needs no locking. Outside of where mode, which does not use the symbolizer,
+// BFD is only ever used by the worker thread. Requests that do not fit in the
+// queue are remembered, and submitted again the next time the sampler finds
+// their provisional frame in the frame cache.
+
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../cache.h"
+#include "../events.h"
+#include "../frame.h"
+#include "../hints.h"
+#include "../logging.h"
+#include "../py_string.h"
+#include "addr2line.h"
+
+#define SYMBOLIZER_QUEUE_SIZE 1024
+
+typedef struct _symbol_request {
+    void*        owner; // The process that requested the resolution
+    key_dt       key;
+    char*        module;
+    bfd_vma      offset;
+    char*        source;
+    char*        name;
+    unsigned int line;
+
+    struct _symbol_request* next;
+} symbol_request_t;
+
+typedef struct {
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    bool            running;
+    bool            stop;
+
+    // Requests are consumed in FIFO order by the worker, which then moves them
+    // over to the list of resolved requests.
+    symbol_request_t* pending_head;
+    symbol_request_t* pending_tail;
+    size_t            pending;
+    symbol_request_t* resolved;
+
+    // The owner of the request being resolved, reset if the owner is
+    // discarded in the meantime.
+    void* working;
+
+    // The keys of the frames whose requests were dropped, mixed with their
+    // owners. This is only used by the sampler thread, so it needs no locking.
+    lookup_t* deferred_keys;
+    size_t    deferred;
+
+    size_t submitted;
+    size_t dropped;
+    size_t unresolved;
+} symbolizer_t;
+
+#define _symbolizer__deferred_key(owner, key) ((key) ^ (key_dt)(uintptr_t)(owner))
+
+static symbolizer_t _symbolizer = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+// ----------------------------------------------------------------------------
+static inline void
+_symbol_request__destroy(symbol_request_t* self) {
+    if (!isvalid(self))
+        return;
+
+    sfree(self->module);
+    sfree(self->source);
+    sfree(self->name);
+
+    free(self);
+}
+
+// ----------------------------------------------------------------------------
+static inline void
+_symbol_requests__destroy(symbol_request_t* head) {
+    while (isvalid(head)) {
+        symbol_request_t* next = head->next;
+        _symbol_request__destroy(head);
+        head = next;
+    }
+}
+
+// ----------------------------------------------------------------------------
+static void*
+_symbolizer__worker(void* arg) {
+    symbolizer_t* self = (symbolizer_t*)arg;
+
+    pthread_mutex_lock(&self->lock);
+    for (;;) {
+        while (!self->stop && !isvalid(self->pending_head))
+            pthread_cond_wait(&self->cond, &self->lock);
+        if (self->stop)
+            break;
+
+        symbol_request_t* request = self->pending_head;
+        self->pending_head        = request->next;
+        if (!isvalid(self->pending_head))
+            self->pending_tail = NULL;
+        self->pending--;
+        self->working = request->owner;
+
+        pthread_mutex_unlock(&self->lock);
+
+        const char* source = NULL;
+        bool        ok     = success(
+            resolve_native_location(request->module, request->offset, &source, &request->name, &request->line)
+        );
+        if (ok) {
+            request->source = strdup(source);
+            ok              = isvalid(request->source);
+        }
+
+        pthread_mutex_lock(&self->lock);
+
+        if (!ok)
+            self->unresolved++;
+
+        if (ok && self->working == request->owner) {
+            request->next  = self->resolved;
+            self->resolved = request;
+        } else {
+            _symbol_request__destroy(request);
+        }
+        self->working = NULL;
+    }
+    pthread_mutex_unlock(&self->lock);
+
+    return NULL;
+}
+
+// ----------------------------------------------------------------------------
+static inline void
+_symbolizer__defer(symbolizer_t* self, void* owner, key_dt key) {
+    if (!isvalid(self->deferred_keys) && !isvalid(self->deferred_keys = lookup_new(64)))
+        return; // GCOV_EXCL_LINE
+
+    key_dt deferred_key = _symbolizer__deferred_key(owner, key);
+    if (!isvalid(lookup__get(self->deferred_keys, deferred_key))) {
+        lookup__set(self->deferred_keys, deferred_key, (value_t)owner);
+        self->deferred++;
+    }
+}
+
+// ----------------------------------------------------------------------------
+static inline void
+_symbolizer__undefer(symbolizer_t* self, void* owner, key_dt key) {
+    if (self->deferred == 0)
+        return;
+
+    key_dt deferred_key = _symbolizer__deferred_key(owner, key);
+    if (lookup__get(self->deferred_keys, deferred_key) == owner) {
+        lookup__del(self->deferred_keys, deferred_key);
+        self->deferred--;
+    }
+}
+
+// ----------------------------------------------------------------------------
+/**
+ * Queue a native frame for symbolisation. This never blocks: if the worker is
+ * lagging behind, the request is dropped and the frame stays provisional until
+ * it is submitted again with symbolizer__retry.
+ *
+ * @param owner   the process the frame belongs to
+ * @param key     the key of the provisional frame
+ * @param module  the path of the module that contains the frame
+ * @param offset  the offset of the frame within the module
+ */
+static inline void
+symbolizer__submit(void* owner, key_dt key, const char* module, bfd_vma offset) {
+    symbolizer_t* self = &_symbolizer;
+
+    if (!self->running) {
+        if (pthread_create(&self->thread, NULL, _symbolizer__worker, self)) { // GCOV_EXCL_START
+            log_e("Failed to start the native symbolizer");
+            return;
+        } // GCOV_EXCL_STOP
+        self->running = true;
+    }
+
+    symbol_request_t* request = (symbol_request_t*)calloc(1, sizeof(symbol_request_t));
+    if (!isvalid(request)) // GCOV_EXCL_LINE
+        return;            // GCOV_EXCL_LINE
+
+    request->owner  = owner;
+    request->key    = key;
+    request->module = strdup(module);
+    request->offset = offset;
+    if (!isvalid(request->module)) { // GCOV_EXCL_START
+        free(request);
+        return;
+    } // GCOV_EXCL_STOP
+
+    pthread_mutex_lock(&self->lock);
+    if (self->pending >= SYMBOLIZER_QUEUE_SIZE) {
+        self->dropped++;
+        pthread_mutex_unlock(&self->lock);
+        _symbol_request__destroy(request);
+        _symbolizer__defer(self, owner, key);
+        return;
+    }
+    if (isvalid(self->pending_tail))
+        self->pending_tail->next = request;
+    else
+        self->pending_head = request;
+    self->pending_tail = request;
+    self->pending++;
+    self->submitted++;
+    pthread_cond_signal(&self->cond);
+    pthread_mutex_unlock(&self->lock);
+
+    _symbolizer__undefer(self, owner, key);
+}
+
+// ----------------------------------------------------------------------------
+/**
+ * Submit a provisional frame found in the frame cache again, if its request
+ * was dropped because the queue was full. This must be called from the
+ * sampling thread.
+ *
+ * @param owner  the process the frame belongs to
+ * @param frame  the provisional frame, with the module as the file name and
+ *               the offset within it as the line number
+ */
+static inline void
+symbolizer__retry(void* owner, frame_t* frame) {
+    symbolizer_t* self = &_symbolizer;
+
+    if (self->deferred == 0
+        || lookup__get(self->deferred_keys, _symbolizer__deferred_key(owner, frame->key)) != owner)
+        return;
+
+    symbolizer__submit(owner, frame->key, frame->filename->value, frame->line);
+}
+
+// ----------------------------------------------------------------------------
+static inline cached_string_t*
+_symbolizer__string(lru_cache_t* string_cache, char* value) {
+    key_dt           key    = (key_dt)string__hash(value);
+    cached_string_t* string = lru_cache__maybe_hit(string_cache, key);
+    if (isvalid(string))
+        return string;
+
+    char* copy = strdup(value);
+    if (!isvalid(copy)) // GCOV_EXCL_LINE
+        return NULL;    // GCOV_EXCL_LINE
+
+    string = cached_string_new(key, copy);
+    if (!isvalid(string)) { // GCOV_EXCL_START
+        free(copy);
+        return NULL;
+    } // GCOV_EXCL_STOP
+
+    lru_cache__store(string_cache, key, (value_t)string);
+    event_handler__emit_new_string(string);
+
+    return string;
+}
+
+// ----------------------------------------------------------------------------
+// Unlink the requests of the given owner from a list and return them.
+static inline symbol_request_t*
+_symbol_requests__take(symbol_request_t** head, symbol_request_t** tail, void* owner) {
+    symbol_request_t*  taken = NULL;
+    symbol_request_t** link  = head;
+    symbol_request_t*  last  = NULL;
+
+    while (isvalid(*link)) {
+        symbol_request_t* request = *link;
+        if (request->owner == owner) {
+            *link         = request->next;
+            request->next = taken;
+            taken         = request;
+        } else {
+            last = request;
+            link = &request->next;
+        }
+    }
+
+    if (isvalid(tail))
+        *tail = last;
+
+    return taken;
+}
+
+// ----------------------------------------------------------------------------
+/**
+ * Emit the updated definitions of the frames of the given process that have
+ * been resolved since the last call. The results of the other processes are
+ * left for them to collect. This must be called from the sampling thread.
+ *
+ * @param owner         the process that is being sampled
+ * @param frame_cache   the frame cache of the process
+ * @param string_cache  the string cache of the process
+ */
+static inline void
+symbolizer__drain(void* owner, lru_cache_t* frame_cache, lru_cache_t* string_cache) {
+    symbolizer_t* self = &_symbolizer;
+
+    pthread_mutex_lock(&self->lock);
+    symbol_request_t* request = _symbol_requests__take(&self->resolved, NULL, owner);
+    pthread_mutex_unlock(&self->lock);
+
+    for (symbol_request_t* next; isvalid(request); request = next) {
+        next = request->next;
+
+        cached_string_t* source = _symbolizer__string(string_cache, request->source);
+        cached_string_t* name   = _symbolizer__string(string_cache, request->name);
+        if (isvalid(source) && isvalid(name)) {
+            // Update the cached frame in place, if we still have it, so that
+            // the next samples do not have to go through the symbolizer again.
+            frame_t* frame = lru_cache__maybe_hit(frame_cache, request->key);
+            frame_t  update;
+            if (!isvalid(frame)) {
+                frame      = &update;
+                frame->key = request->key;
+            }
+            frame->filename   = source;
+            frame->scope      = name;
+            frame->line       = request->line;
+            frame->line_end   = 0;
+            frame->column     = 0;
+            frame->column_end = 0;
+
+            event_handler__emit_new_frame(frame);
+        }
+
+        _symbol_request__destroy(request);
+    }
+}
+
+// ----------------------------------------------------------------------------
+/**
+ * Discard all the requests of the given owner, resolved or not, e.g. when the
+ * process that submitted them goes away.
+ *
+ * @param owner  the process that submitted the requests
+ */
+static inline void
+symbolizer__discard(void* owner) {
+    symbolizer_t* self = &_symbolizer;
+
+    if (!self->running)
+        return;
+
+    pthread_mutex_lock(&self->lock);
+
+    symbol_request_t* pending = _symbol_requests__take(&self->pending_head, &self->pending_tail, owner);
+    for (symbol_request_t* request = pending; isvalid(request); request = request->next)
+        self->pending--;
+    _symbol_requests__destroy(pending);
+
+    _symbol_requests__destroy(_symbol_requests__take(&self->resolved, NULL, owner));
+
+    if (self->working == owner)
+        self->working = NULL;
+
+    pthread_mutex_unlock(&self->lock);
+
+    if (self->deferred > 0) {
+        // Collect the keys first, as the lookup cannot change while we iterate.
+        key_dt* keys = (key_dt*)malloc(self->deferred * sizeof(key_dt));
+        if (!isvalid(keys)) // GCOV_EXCL_LINE
+            return;         // GCOV_EXCL_LINE
+
+        size_t n = 0;
+        lookup__iteritems_start(self->deferred_keys, key_dt, key, void*, entry_owner) {
+            if (entry_owner == owner)
+                keys[n++] = key;
+        }
+        lookup__iter_stop(self->deferred_keys);
+
+        for (size_t i = 0; i < n; i++)
+            lookup__del(self->deferred_keys, keys[i]);
+        self->deferred -= n;
+
+        free(keys);
+    }
+}
+
+// ----------------------------------------------------------------------------
+/**
+ * Stop the worker thread and discard any outstanding requests.
+ */
+static inline void
+symbolizer__stop(void) {
+    symbolizer_t* self = &_symbolizer;
+
+    if (!self->running)
+        return;
+
+    pthread_mutex_lock(&self->lock);
+    self->stop = true;
+    pthread_cond_signal(&self->cond);
+    pthread_mutex_unlock(&self->lock);
+
+    pthread_join(self->thread, NULL);
+    self->running = false;
+
+    log_d(
+        "Native symbolizer: %zu submitted, %zu dropped, %zu unresolved, %zu pending, %zu deferred", self->submitted,
+        self->dropped, self->unresolved, self->pending, self->deferred
+    );
+
+    _symbol_requests__destroy(self->pending_head);
+    _symbol_requests__destroy(self->resolved);
+
+    self->pending_head = self->pending_tail = self->resolved = NULL;
+    self->pending                                            = 0;
+
+    lookup__destroy(self->deferred_keys);
+    self->deferred_keys = NULL;
+    self->deferred      = 0;
+}
@@ -0,0 +1,291 @@
+// This file is part of "austin" which is released under GPL.
+//
+// See file LICENCE or go to http://www.gnu.org/licenses/ for full license
+// details.
+//
+// Austin is a Python frame stack sampler for CPython.
+//
+// Copyright (c) 2018-2025 Gabriele N. Tornetta <phoenix1987@gmail.com>.
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// libunwind accessors for remote unwinding. These are the ptrace ones, except
+// that remote memory is read a page at a time with process_vm_readv, rather
+// than one word at a time with PTRACE_PEEKDATA. Pages are cached for the
+// duration of a single unwind only, since the stack changes between samples.
+//
+// The ptrace accessors call each other with their own argument, so we cannot
+// wrap it. The state of the current unwind is kept here instead, which is why
+// this header must only be included by the module that does the unwinding.
+
+#pragma once
+
+#include <libunwind-ptrace.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#if defined __x86_64__
+#include <elf.h>
+#include <sys/ptrace.h>
+#include <sys/user.h>
+#endif
+
+#include "../error.h"
+#include "../hints.h"
+#include "../logging.h"
+
+#define UNWIND_PAGE_SIZE  4096
+#define UNWIND_PAGE_SLOTS 32
+
+// Frames larger than this are taken as a sign of a broken frame pointer chain.
+#define UNWIND_MAX_FRAME_SIZE (1 << 20)
+
+typedef struct {
+    uintptr_t    page;
+    unsigned int generation;
+    char         data[UNWIND_PAGE_SIZE];
+} unwind_page_t;
+
+// A direct-mapped cache of remote pages. Bumping the generation invalidates
+// all the cached pages at once.
+typedef struct {
+    pid_t         pid;
+    unsigned int  generation;
+    unwind_page_t pages[UNWIND_PAGE_SLOTS];
+
+    size_t hits;
+    size_t misses;
+} unwind_page_cache_t;
+
+static unwind_page_cache_t _unwind_pages   = {.generation = 1};
+static unw_accessors_t     _unwind_accessors;
+
+#if defined __x86_64__
+// The registers of the thread being unwound, read in one go on first access
+// rather than one by one by the ptrace accessors.
+static struct user_regs_struct _unwind_regs;
+static pid_t                   _unwind_regs_tid   = 0;
+static bool                    _unwind_regs_valid = false;
+#endif
+
+// ----------------------------------------------------------------------------
+static inline void
+_unwind_pages__invalidate(void) {
+    if (++_unwind_pages.generation == 0) { // GCOV_EXCL_START
+        for (int i = 0; i < UNWIND_PAGE_SLOTS; i++)
+            _unwind_pages.pages[i].generation = 0;
+        _unwind_pages.generation = 1;
+    } // GCOV_EXCL_STOP
+}
+
+// ----------------------------------------------------------------------------
+// Read a word of remote memory through the page cache.
+static inline int
+_unwind_pages__read(unw_word_t addr, unw_word_t* val) {
+    uintptr_t page   = addr & ~(uintptr_t)(UNWIND_PAGE_SIZE - 1);
+    size_t    offset = addr - page;
+
+    if (offset + sizeof(unw_word_t) > UNWIND_PAGE_SIZE)
+        FAIL;
+
+    unwind_page_t* slot = _unwind_pages.pages + (page / UNWIND_PAGE_SIZE) % UNWIND_PAGE_SLOTS;
+    if (slot->generation != _unwind_pages.generation || slot->page != page) {
+        struct iovec local  = {slot->data, UNWIND_PAGE_SIZE};
+        struct iovec remote = {(void*)page, UNWIND_PAGE_SIZE};
+
+        _unwind_pages.misses++;
+        if (process_vm_readv(_unwind_pages.pid, &local, 1, &remote, 1, 0) != UNWIND_PAGE_SIZE) {
+            slot->generation = 0;
+            FAIL;
+        }
+        slot->page       = page;
+        slot->generation = _unwind_pages.generation;
+    } else {
+        _unwind_pages.hits++;
+    }
+
+    memcpy(val, slot->data + offset, sizeof(unw_word_t));
+
+    SUCCESS;
+}
+
+// ----------------------------------------------------------------------------
+static int
+_unwind__access_mem(unw_addr_space_t as, unw_word_t addr, unw_word_t* val, int write, void* arg) {
+    if (write)
+        _unwind_pages__invalidate();
+    else if (success(_unwind_pages__read(addr, val)))
+        return 0;
+
+    return _UPT_access_mem(as, addr, val, write, arg);
+}
+
+#if defined __x86_64__
+// ----------------------------------------------------------------------------
+static int
+_unwind__access_reg(unw_addr_space_t as, unw_regnum_t reg, unw_word_t* val, int write, void* arg) {
+    if (!_unwind_regs_valid && !write) {
+        // The thread might not have stopped yet, in which case we fall back to
+        // the ptrace accessor, and have the cursor initialisation retried.
+        struct iovec regs  = {&_unwind_regs, sizeof(_unwind_regs)};
+        _unwind_regs_valid = ptrace(PTRACE_GETREGSET, _unwind_regs_tid, (void*)NT_PRSTATUS, &regs) == 0;
+    }
+    if (write || !_unwind_regs_valid)
+        return _UPT_access_reg(as, reg, val, write, arg);
+
+    switch (reg) {
+    // clang-format off
+    case UNW_X86_64_RAX: *val = _unwind_regs.rax; break;
+    case UNW_X86_64_RDX: *val = _unwind_regs.rdx; break;
+    case UNW_X86_64_RCX: *val = _unwind_regs.rcx; break;
+    case UNW_X86_64_RBX: *val = _unwind_regs.rbx; break;
+    case UNW_X86_64_RSI: *val = _unwind_regs.rsi; break;
+    case UNW_X86_64_RDI: *val = _unwind_regs.rdi; break;
+    case UNW_X86_64_RBP: *val = _unwind_regs.rbp; break;
+    case UNW_X86_64_RSP: *val = _unwind_regs.rsp; break;
+    case UNW_X86_64_R8:  *val = _unwind_regs.r8;  break;
+    case UNW_X86_64_R9:  *val = _unwind_regs.r9;  break;
+    case UNW_X86_64_R10: *val = _unwind_regs.r10; break;
+    case UNW_X86_64_R11: *val = _unwind_regs.r11; break;
+    case UNW_X86_64_R12: *val = _unwind_regs.r12; break;
+    case UNW_X86_64_R13: *val = _unwind_regs.r13; break;
+    case UNW_X86_64_R14: *val = _unwind_regs.r14; break;
+    case UNW_X86_64_R15: *val = _unwind_regs.r15; break;
+    case UNW_X86_64_RIP: *val = _unwind_regs.rip; break;
+    // clang-format on
+    default:
+        return _UPT_access_reg(as, reg, val, write, arg);
+    }
+
+    return 0;
+}
+#endif
+
+// ----------------------------------------------------------------------------
+/**
+ * Create an address space for unwinding the threads of a remote process. The
+ * unwind information is cached across threads and samples, so the cache must
+ * be flushed whenever the memory maps of the process change.
+ *
+ * @return a valid address space, NULL otherwise.
+ */
+static inline unw_addr_space_t
+unwind_addr_space_new(void) {
+    _unwind_accessors            = _UPT_accessors;
+    _unwind_accessors.access_mem = _unwind__access_mem;
+#if defined __x86_64__
+    _unwind_accessors.access_reg = _unwind__access_reg;
+#endif
+
+    unw_addr_space_t as = unw_create_addr_space(&_unwind_accessors, 0);
+    if (!isvalid(as)) { // GCOV_EXCL_START
+        set_error(OS, "Failed to create libunwind address space");
+        FAIL_PTR;
+    } // GCOV_EXCL_STOP
+
+    if (unw_set_caching_policy(as, UNW_CACHE_GLOBAL))
+        log_w("Failed to enable libunwind caching"); // GCOV_EXCL_LINE
+
+    return as;
+}
+
+// ----------------------------------------------------------------------------
+/**
+ * Prepare for unwinding a thread of the given process. Any pages and registers
+ * read during a previous unwind are discarded.
+ *
+ * @param pid  the process the thread belongs to
+ * @param tid  the thread to unwind
+ */
+static inline void
+unwind__begin(pid_t pid, pid_t tid) {
+    _unwind_pages.pid = pid;
+    _unwind_pages__invalidate();
+
+#if defined __x86_64__
+    _unwind_regs_tid   = tid;
+    _unwind_regs_valid = false;
+#endif
+}
+
+// ----------------------------------------------------------------------------
+/**
+ * Step to the caller frame by following the frame pointer. This is only
+ * meaningful if the current function has set up its frame pointer.
+ *
+ * @param ip  the instruction pointer of the current frame, updated on success
+ * @param sp  the stack pointer of the current frame, updated on success
+ * @param bp  the frame pointer of the current frame, updated on success
+ *
+ * @return true if the frame pointer chain looks valid, false otherwise.
+ */
+static inline bool
+unwind__fp_step(unw_word_t* ip, unw_word_t* sp, unw_word_t* bp) {
+#if defined __x86_64__
+    unw_word_t next_bp, ret;
+
+    if ((*bp & 7) || *bp < *sp || *bp - *sp > UNWIND_MAX_FRAME_SIZE)
+        return false;
+
+    if (fail(_unwind_pages__read(*bp, &next_bp)) || fail(_unwind_pages__read(*bp + 8, &ret)))
+        return false;
+
+    if (ret == 0 || (next_bp != 0 && next_bp <= *bp))
+        return false;
+
+    *ip = ret;
+    *sp = *bp + 16;
+    *bp = next_bp;
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+// ----------------------------------------------------------------------------
+/**
+ * Make libunwind start from the given frame on the next initialisation of a
+ * cursor, e.g. after a sequence of frame pointer steps. Only the instruction,
+ * stack and frame pointers are known for such a frame, so all the other
+ * registers are cleared rather than left with the values of the innermost
+ * frame.
+ *
+ * @return true if the registers could be set, false otherwise.
+ */
+static inline bool
+unwind__set_frame(unw_word_t ip, unw_word_t sp, unw_word_t bp) {
+#if defined __x86_64__
+    if (!_unwind_regs_valid)
+        return false;
+
+    memset(&_unwind_regs, 0, sizeof(_unwind_regs));
+
+    _unwind_regs.rip = ip;
+    _unwind_regs.rsp = sp;
+    _unwind_regs.rbp = bp;
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+// ----------------------------------------------------------------------------
+static inline void
+unwind__log_stats(void) {
+    log_d("Unwind page cache: %zu hits, %zu misses", _unwind_pages.hits, _unwind_pages.misses);
+}
@@ -0,0 +1,169 @@
+// This file is part of "austin" which is released under GPL.
+//
+// See file LICENCE or go to http://www.gnu.org/licenses/ for full license
+// details.
+//
+// Austin is a Python frame stack sampler for CPython.
+//
+// Copyright (c) 2018-2022 Gabriele N. Tornetta <phoenix1987@gmail.com>.
+// All rights reserved.
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "../error.h"
+#include "../hints.h"
+
+typedef uintptr_t addr_t;
+
+typedef struct {
+    addr_t lo, hi;
+    addr_t base; // Load address of the object the range belongs to
+    char*  name;
+
+    struct _symbol_index* symbols; // The symbol index of the object, loaded lazily
+} vm_range_t;
+
+// Pseudo-maps, like [vdso] or [stack], are not backed by an object file.
+#define vm_range__is_pseudo(range) ((range)->name[0] == '[')
+
+// A table of *non-overlapping* VM ranges, stored in a contiguous array sorted
+// by lower bound for fast look-ups.
+typedef struct _vm_range_table {
+    vm_range_t* ranges;
+    size_t      count;
+    size_t      capacity;
+} vm_range_table_t;
+
+/**
+ * Create a new VM range table.
+ *
+ * @return a valid reference to a new VM range table, NULL otherwise.
+ */
+static inline vm_range_table_t*
+vm_range_table_new(void) {
+    vm_range_table_t* self = (vm_range_table_t*)calloc(1, sizeof(vm_range_table_t));
+    if (!isvalid(self)) { // GCOV_EXCL_START
+        set_error(MALLOC, "Cannot allocate memory for VM range table");
+        FAIL_PTR;
+    } // GCOV_EXCL_STOP
+
+    return self;
+}
+
+/**
+ * Remove all the ranges from the table. The allocated storage is retained so
+ * that the table can be rebuilt cheaply when the memory maps change.
+ *
+ * @param self  the VM range table.
+ */
+static inline void
+vm_range_table__clear(vm_range_table_t* self) {
+    for (size_t i = 0; i < self->count; i++)
+        sfree(self->ranges[i].name);
+
+    self->count = 0;
+}
+
+/**
+ * Add a new range to the VM range table.
+ *
+ * The callee has the responsibility of ensuring that all the VM ranges that
+ * are added to this data structure are *non-overlapping*. Ranges are expected
+ * to be added in ascending order, as they appear in the memory maps; anything
+ * else is still handled, at the cost of an insertion.
+ *
+ * @param self  the VM range table.
+ * @param lo    the range lower bound
+ * @param hi    the range upper bound
+ * @param base  the load address of the mapped object
+ * @param name  the name of the VM map (takes ownership)
+ *
+ * @return a valid reference to the new range, NULL otherwise.
+ */
+static inline vm_range_t*
+vm_range_table__add(vm_range_table_t* self, addr_t lo, addr_t hi, addr_t base, char* name) {
+    if (self->count == self->capacity) {
+        size_t      capacity = self->capacity ? self->capacity << 1 : 64;
+        vm_range_t* resized  = (vm_range_t*)realloc(self->ranges, capacity * sizeof(vm_range_t));
+        if (!isvalid(resized)) { // GCOV_EXCL_START
+            set_error(MALLOC, "Cannot allocate memory for VM ranges");
+            FAIL_PTR;
+        } // GCOV_EXCL_STOP
+        self->ranges   = resized;
+        self->capacity = capacity;
+    }
+
+    size_t i = self->count++;
+    for (; i > 0 && self->ranges[i - 1].lo > lo; i--)
+        self->ranges[i] = self->ranges[i - 1];
+
+    vm_range_t* range = self->ranges + i;
+
+    range->lo   = lo;
+    range->hi   = hi;
+    range->base = base;
+    range->name = name;
+
+    range->symbols = NULL;
+
+    return range;
+}
+
+/**
+ * Query the table for the range that contains the given address (if any).
+ *
+ * If any of the ranges stored within the VM range table overlap, the result of
+ * this method might be meaningless.
+ *
+ * @param self  the VM range table to query.
+ * @param addr  the address to look up.
+ *
+ * @return a valid reference to a VM range, NULL otherwise.
+ */
+static inline vm_range_t*
+vm_range_table__find(vm_range_table_t* self, addr_t addr) {
+    size_t n = self->count;
+    if (n == 0)
+        return NULL;
+
+    // Branchless binary search for the last range with lo <= addr.
+    vm_range_t* base = self->ranges;
+    while (n > 1) {
+        size_t half  = n >> 1;
+        base        += (base[half].lo <= addr) * half;
+        n           -= half;
+    }
+
+    return base->lo <= addr && addr < base->hi ? base : NULL;
+}
+
+/**
+ * Deallocate a VM range table, together with all its ranges.
+ *
+ * @param self  the VM range table to deallocate.
+ */
+static inline void
+vm_range_table__destroy(vm_range_table_t* self) {
+    if (!isvalid(self))
+        return;
+
+    vm_range_table__clear(self);
+    sfree(self->ranges);
+
+    free(self);
+}
@@ -52,6 +52,7 @@ __declspec(dllimport) extern BOOL GetPhysicallyInstalledSystemMemory(PULONGLONG)
 
 #include "error.h"
 #include "logging.h"
+#include "resources.h"
 
 /**
  * Copy a data structure from the given remote address structure.
@@ -186,6 +187,111 @@ copy_memory(proc_ref_t proc_ref, raddr_t restrict addr, ssize_t len, void* restr
     return result != len;
 }
 
+/**
+ * A half-open range [lo, hi) of remote addresses.
+ */
+typedef struct {
+    raddr_t lo;
+    raddr_t hi;
+} addr_range_t;
+
+CLEANUP_FUNC(addr_range_t, free);
+#define cu_addr_range_t __attribute__((cleanup(freeaddr_range_t))) addr_range_t
+
+/**
+ * Check whether a remote address falls within any of the given ranges.
+ * @param  ranges  an array of non-overlapping ranges, sorted by address.
+ * @param  n       the number of ranges in the array.
+ * @param  addr    the remote address to look up.
+ * @return         true if the address is within one of the ranges.
+ */
+static inline bool
+addr_ranges__contains(addr_range_t* ranges, size_t n, raddr_t addr) {
+    if (n == 0)
+        return false;
+
+    addr_range_t* base = ranges;
+    while (n > 1) {
+        size_t half  = n >> 1;
+        base        += (base[half].lo <= addr) * half;
+        n           -= half;
+    }
+
+    return base->lo <= addr && addr < base->hi;
+}
+
+#define COPY_MEMORY_BATCH_MAX 64
+
+/**
+ * Copy several chunks of remote memory of the same size in as few system
+ * calls as possible. A chunk that cannot be read does not cause the whole
+ * batch to fail; it is just marked as such.
+ * @param proc_ref  the process reference (platform-dependent)
+ * @param addrs     the remote addresses of the chunks
+ * @param n         the number of chunks
+ * @param len       the size of each chunk
+ * @param buf       the destination buffer, at least n * len bytes large
+ * @param ok        set to true for every chunk that has been copied in full
+ *
+ * @return  zero on success, non-zero if the remote memory cannot be accessed
+ *          at all.
+ */
+static inline int
+copy_memory_batch(proc_ref_t proc_ref, raddr_t* addrs, size_t n, size_t len, void* buf, bool* ok) {
+#if defined(PL_LINUX) /* LINUX */
+    struct iovec local[COPY_MEMORY_BATCH_MAX];
+    struct iovec remote[COPY_MEMORY_BATCH_MAX];
+
+    for (size_t i = 0; i < n;) {
+        size_t m = n - i < COPY_MEMORY_BATCH_MAX ? n - i : COPY_MEMORY_BATCH_MAX;
+        for (size_t j = 0; j < m; j++) {
+            local[j].iov_base  = (char*)buf + (i + j) * len;
+            local[j].iov_len   = len;
+            remote[j].iov_base = addrs[i + j];
+            remote[j].iov_len  = len;
+        }
+
+        // Partial transfers happen at the granularity of the iovec elements, so
+        // everything before the first short element has been copied in full.
+        ssize_t result = process_vm_readv(proc_ref, local, m, remote, m, 0);
+        if (result == -1) {
+            switch (errno) {
+            case ESRCH:
+                set_error(OS, "No such process");
+                FAIL;
+            case EPERM:
+                set_error(PERM, "Remote memory read access denied");
+                FAIL;
+            default:
+                result = 0;
+            }
+        }
+
+        size_t done = result / len;
+        for (size_t j = 0; j < done; j++)
+            ok[i + j] = true;
+
+        if (done < m) {
+            // Skip the chunk that could not be read and carry on with the rest.
+            ok[i + done]  = false;
+            done         += 1;
+        }
+
+        i += done;
+    }
+
+#else
+    for (size_t i = 0; i < n; i++) {
+        ok[i] = success(copy_memory(proc_ref, addrs[i], len, (char*)buf + i * len));
+        if (!ok[i] && (error_is(OS) || error_is(PERM)))
+            FAIL;
+    }
+
+#endif
+
+    SUCCESS;
+}
+
 /**
  * Return the total physical memory installed on the system, in KB.
  * @return  the total physical memory installed on the system, in KB.
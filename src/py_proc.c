@@ -67,6 +67,8 @@
 #endif
 #define MAX_STRING_CACHE_SIZE LRU_CACHE_EXPAND
 #define MAX_CODE_CACHE_SIZE   LRU_CACHE_EXPAND
+#define MAX_STACK_CACHE_SIZE  1024 // Threads whose previous stack we remember
+#define MAX_TID_CACHE_SIZE    1024 // Thread states whose TID we remember
 
 #define py_proc__memcpy(self, raddr, size, dest) copy_memory(self->ref, raddr, size, dest)
 
@@ -236,6 +238,82 @@ _find_version_in_binary(char* path, int* version) {
 } /* _find_version_in_binary */
 #endif
 
+// ----------------------------------------------------------------------------
+static inline bool
+_debug_offsets__is_valid(_Py_DebugOffsets* py_d) {
+    // The fields we check are common to all the supported layouts.
+    if (memcmp(py_d->v3_13.cookie, _Py_Debug_Cookie, sizeof(py_d->v3_13.cookie)))
+        return false;
+
+    uint64_t version = py_d->v3_13.version;
+    if (((version >> 24) & 0xFF) != 3 || ((version >> 16) & 0xFF) < 13)
+        return false;
+
+    return py_d->v3_13.runtime_state.interpreters_head < py_d->v3_13.runtime_state.size;
+}
+
+// ----------------------------------------------------------------------------
+// Starting with Python 3.13, the _PyRuntime structure begins with a
+// _Py_DebugOffsets structure. This gives us the version and all the offsets
+// we need in one go, so we try to locate it before resorting to any other
+// method. If we have no symbols we look for the debug cookie within the first
+// page of the runtime section.
+static int
+_py_proc__find_debug_offsets(py_proc_t* self, _Py_DebugOffsets* py_d) {
+    if (isvalid(self->symbols[DYNSYM_RUNTIME])) {
+        if (fail(py_proc__get_type(self, self->symbols[DYNSYM_RUNTIME], *py_d))) {
+            log_d("Cannot copy PyRuntimeState structure from remote address");
+            FAIL;
+        }
+
+        if (!_debug_offsets__is_valid(py_d)) {
+            log_d("PyRuntimeState structure does not match expected cookie");
+            FAIL;
+        }
+
+        SUCCESS;
+    }
+
+    if (!isvalid(self->map.runtime.base))
+        FAIL;
+
+    size_t size = get_page_size() + sizeof(_Py_DebugOffsets);
+    if (size > self->map.runtime.size)
+        size = self->map.runtime.size;
+    if (size < sizeof(_Py_DebugOffsets))
+        FAIL;
+
+    cu_void* buffer = malloc(size);
+    if (!isvalid(buffer)) { // GCOV_EXCL_START
+        set_error(MALLOC, "Cannot allocate memory for runtime section scan");
+        FAIL;
+    } // GCOV_EXCL_STOP
+
+    if (fail(py_proc__memcpy(self, self->map.runtime.base, size, buffer))) {
+        log_d("Cannot copy runtime section from remote address %p", self->map.runtime.base);
+        FAIL;
+    }
+
+    for (size_t offset = 0; offset + sizeof(_Py_DebugOffsets) <= size; offset += sizeof(raddr_t)) {
+        _Py_DebugOffsets* candidate = (_Py_DebugOffsets*)((char*)buffer + offset);
+        if (!_debug_offsets__is_valid(candidate))
+            continue;
+
+        memcpy(py_d, candidate, sizeof(_Py_DebugOffsets));
+
+        // The debug offsets are the first member of _PyRuntime, so we now know
+        // exactly where the runtime state lives.
+        self->symbols[DYNSYM_RUNTIME] = self->map.runtime.base + offset;
+        log_d("Debug offsets found in runtime section @ %p", self->symbols[DYNSYM_RUNTIME]);
+
+        SUCCESS;
+    }
+
+    log_d("No debug offsets found in runtime section");
+    FAIL;
+}
+
+// ----------------------------------------------------------------------------
 static int
 _py_proc__infer_python_version(py_proc_t* self) {
     if (!isvalid(self)) { // GCOV_EXCL_START
@@ -246,31 +324,23 @@ _py_proc__infer_python_version(py_proc_t* self) {
     int major = 0, minor = 0, patch = 0;
 
     // Starting with Python 3.13 we can use the PyRuntime structure
-    if (isvalid(self->symbols[DYNSYM_RUNTIME])) {
-        _Py_DebugOffsets py_d;
-        if (fail(py_proc__get_type(self, self->symbols[DYNSYM_RUNTIME], py_d))) {
-            log_e("Cannot copy PyRuntimeState structure from remote address");
-            FAIL;
-        }
-
-        if (0 == memcmp(py_d.v3_13.cookie, _Py_Debug_Cookie, sizeof(py_d.v3_13.cookie))) {
-            uint64_t version = py_d.v3_13.version;
-            major            = (version >> 24) & 0xFF;
-            minor            = (version >> 16) & 0xFF;
-            patch            = (version >> 8) & 0xFF;
+    _Py_DebugOffsets py_d;
+    if (success(_py_proc__find_debug_offsets(self, &py_d))) {
+        uint64_t version = py_d.v3_13.version;
+        major            = (version >> 24) & 0xFF;
+        minor            = (version >> 16) & 0xFF;
+        patch            = (version >> 8) & 0xFF;
 
-            log_d("Python version (from debug offsets): %d.%d.%d", major, minor, patch);
+        log_d("Python version (from debug offsets): %d.%d.%d", major, minor, patch);
 
-            self->py_v = get_version_descriptor(major, minor, patch);
-            if (!isvalid(self->py_v)) { // GCOV_EXCL_START
-                FAIL;
-            } // GCOV_EXCL_STOP
+        self->py_v = get_version_descriptor(major, minor, patch);
+        if (!isvalid(self->py_v)) { // GCOV_EXCL_START
+            FAIL;
+        } // GCOV_EXCL_STOP
 
-            init_version_descriptor(self->py_v, &py_d);
+        init_version_descriptor(self->py_v, &py_d);
 
-            SUCCESS;
-        }
-        log_d("PyRuntimeState structure does not match expected cookie");
+        SUCCESS;
     }
 
     // Starting with Python 3.11 we can rely on the Py_Version symbol
@@ -297,6 +367,24 @@ _py_proc__infer_python_version(py_proc_t* self) {
         SUCCESS;
     }
 
+    // Before Python 3.11 we can look for the version string in the read-only
+    // data of the binary, unless it contradicts the library file name.
+    if (self->bin_version) {
+        major = MAJOR(self->bin_version);
+        minor = MINOR(self->bin_version);
+        patch = PATCH(self->bin_version);
+
+        int lib_major = 0, lib_minor = 0, lib_patch = 0;
+        if (!isvalid(self->lib_path)
+            || fail(_get_version_from_filename(self->lib_path, LIB_NEEDLE, &lib_major, &lib_minor, &lib_patch))
+            || (lib_major == major && lib_minor == minor)) {
+            log_d("Python version (from binary data): %d.%d.%d", major, minor, patch);
+            goto set_version;
+        }
+
+        log_d("Ignoring version %d.%d.%d from binary data as it does not match the library", major, minor, patch);
+    }
+
     // Try to infer the Python version from the library file name.
     if (isvalid(self->lib_path)
         && success(_get_version_from_filename(self->lib_path, LIB_NEEDLE, &major, &minor, &patch)))
@@ -447,6 +535,74 @@ _py_proc__check_interp_state(py_proc_t* self, raddr_t interp) {
     SUCCESS;
 }
 
+// ----------------------------------------------------------------------------
+#define INTERP_BATCH_SIZE 256
+
+// Discard the candidate interpreter states whose thread state head does not
+// point back to them. All the candidates are checked with just two batched
+// remote reads, one for the thread state heads and one for the interpreter
+// field of the thread states. The surviving candidates are moved to the front
+// of the array and their number is returned via n.
+static int
+_py_proc__filter_interp_states(py_proc_t* self, raddr_t* candidates, size_t* n) {
+    if (!isvalid(self) || *n > INTERP_BATCH_SIZE) { // GCOV_EXCL_START
+        set_error(NULL, "Invalid interpreter state batch");
+        FAIL;
+    } // GCOV_EXCL_STOP
+
+    V_DESC(self->py_v);
+
+    raddr_t addrs[INTERP_BATCH_SIZE];
+    raddr_t heads[INTERP_BATCH_SIZE];
+    raddr_t values[INTERP_BATCH_SIZE];
+    bool    ok[INTERP_BATCH_SIZE];
+    size_t  m = 0;
+
+    for (size_t i = 0; i < *n; i++)
+        addrs[i] = candidates[i] + py_v->py_is.o_tstate_head;
+
+    if (fail(copy_memory_batch(self->ref, addrs, *n, sizeof(raddr_t), values, ok)))
+        FAIL;
+
+    for (size_t i = 0; i < *n; i++) {
+        if (ok[i] && isvalid(values[i])) {
+            candidates[m] = candidates[i];
+            heads[m++]    = values[i];
+        }
+    }
+
+    for (size_t i = 0; i < m; i++)
+        addrs[i] = heads[i] + py_v->py_thread.o_interp;
+
+    if (fail(copy_memory_batch(self->ref, addrs, m, sizeof(raddr_t), values, ok)))
+        FAIL;
+
+    *n = 0;
+    for (size_t i = 0; i < m; i++) {
+        if (ok[i] && values[i] == candidates[i])
+            candidates[(*n)++] = candidates[i];
+    }
+
+    SUCCESS;
+}
+
+// ----------------------------------------------------------------------------
+#define SCAN_LANES 8
+
+// Return a bitmask of the words that could be aligned pointers within [lo, hi).
+// The loop body has no branches so that the compiler can vectorise it.
+static inline uint32_t
+_scan_bss__prefilter(raddr_t* words, size_t lanes, uintptr_t lo, uintptr_t hi) {
+    uint32_t mask = 0;
+
+    for (size_t i = 0; i < lanes; i++) {
+        uintptr_t word  = (uintptr_t)words[i];
+        mask           |= (uint32_t)((word - lo < hi - lo) & !(word & (sizeof(raddr_t) - 1))) << i;
+    }
+
+    return mask;
+}
+
 // ----------------------------------------------------------------------------
 static int
 _py_proc__scan_bss(py_proc_t* self) {
@@ -475,6 +631,21 @@ _py_proc__scan_bss(py_proc_t* self) {
         FAIL;
     } // GCOV_EXCL_STOP
 
+    // Pointers to the interpreter state can only point to writable memory, so
+    // we use the writable ranges of the process, when available, to discard
+    // most of the words without having to probe them remotely.
+    cu_addr_range_t* ranges   = NULL;
+    size_t           n_ranges = 0;
+    uintptr_t        lo = 1, hi = UINTPTR_MAX;
+#if defined PL_LINUX
+    if (isvalid(self->extra->maps) && success(proc_maps__refresh(self->extra->maps)))
+        ranges = proc_maps__writable_ranges(self->extra->maps, &n_ranges);
+    if (isvalid(ranges)) {
+        lo = (uintptr_t)ranges[0].lo;
+        hi = (uintptr_t)ranges[n_ranges - 1].hi;
+    }
+#endif
+
     size_t step = self->map.bss.size > 0x10000 ? 0x10000 : self->map.bss.size;
 
     for (int shift = 0; shift < 1; shift++) {
@@ -485,21 +656,45 @@ _py_proc__scan_bss(py_proc_t* self) {
 
         log_d("Scanning the BSS section @ %p (shift %d)", base, shift);
 
-        void* upper_bound = (void*)((char*)bss + (shift ? step : self->map.bss.size));
-        for (register raddr_t* raddr = (raddr_t*)bss; (raddr_t)raddr < upper_bound; raddr++) {
-            if ((!shift && success(_py_proc__check_interp_state(self, *raddr)))
-                || (shift && success(_py_proc__check_interp_state(self, (raddr_t)raddr - bss + base)))) {
-                log_d(
-                    "Possible interpreter state referenced by BSS @ %p (offset %x)",
-                    (raddr_t)raddr - (raddr_t)bss + (raddr_t)base, (raddr_t)raddr - (raddr_t)bss
-                );
-                self->istate_raddr = shift ? (raddr_t)raddr - bss + base : *raddr;
-                SUCCESS;
+        raddr_t* words = (raddr_t*)bss;
+        size_t   n     = (shift ? step : self->map.bss.size) / sizeof(raddr_t);
+        raddr_t  candidates[INTERP_BATCH_SIZE];
+        size_t   n_candidates = 0;
+
+        for (size_t i = 0; i < n; i += SCAN_LANES) {
+            size_t   lanes = n - i < SCAN_LANES ? n - i : SCAN_LANES;
+            uint32_t mask  = shift ? (1U << lanes) - 1 : _scan_bss__prefilter(words + i, lanes, lo, hi);
+
+            for (; mask; mask &= mask - 1) {
+                raddr_t* raddr = words + i + __builtin_ctz(mask);
+
+                if (!shift && isvalid(ranges) && !addr_ranges__contains(ranges, n_ranges, *raddr))
+                    continue;
+
+                candidates[n_candidates++] = shift ? (raddr_t)raddr - bss + base : *raddr;
             }
 
-            // If we don't have symbols we tolerate memory copy errors.
-            if (error_is(OS) || (self->sym_loaded && error_is(MEMCOPY)))
+            // Validate the candidates in batches. Only those that pass the
+            // batched check are worth the full interpreter state check.
+            if (n_candidates + SCAN_LANES <= INTERP_BATCH_SIZE && i + SCAN_LANES < n)
+                continue;
+
+            if (fail(_py_proc__filter_interp_states(self, candidates, &n_candidates)))
                 FAIL;
+
+            for (size_t j = 0; j < n_candidates; j++) {
+                if (success(_py_proc__check_interp_state(self, candidates[j]))) {
+                    log_d("Possible interpreter state referenced by BSS @ %p", candidates[j]);
+                    self->istate_raddr = candidates[j];
+                    SUCCESS;
+                }
+
+                // If we don't have symbols we tolerate memory copy errors.
+                if (error_is(OS) || (self->sym_loaded && error_is(MEMCOPY)))
+                    FAIL;
+            }
+
+            n_candidates = 0;
         }
 #if defined PL_WIN
         break;
@@ -545,11 +740,28 @@ _py_proc__deref_interp_head(py_proc_t* self) {
 
     V_DESC(self->py_v);
 
-    V_ALLOCA(runtime, runtime);
+    raddr_t runtime_addr = self->symbols[DYNSYM_RUNTIME];
 
-    raddr_t interp_head_raddr = NULL;
+    if (V_MIN(3, 13) && isvalid(runtime_addr)) {
+        // The offsets come from the debug offsets of the runtime itself, so we
+        // only need to read the interpreter head field.
+        raddr_t interp_head_raddr = NULL;
+        if (fail(py_proc__copy_field_v(self, runtime, interp_head, runtime_addr, interp_head_raddr))) {
+            log_d("Cannot read interpreter head from runtime state @ %p", runtime_addr);
+            FAIL;
+        }
+
+        if (fail(_py_proc__prefetch_interpreter_state(self, interp_head_raddr))
+            || fail(_py_proc__check_interp_state(self, interp_head_raddr))) {
+            log_d("Interpreter state check failed while dereferencing runtime state");
+            FAIL;
+        }
+
+        self->istate_raddr = interp_head_raddr;
+
+        SUCCESS;
+    }
 
-    raddr_t runtime_addr = self->symbols[DYNSYM_RUNTIME];
 #if defined PL_LINUX
     const size_t size = getpagesize();
 #else
@@ -567,35 +779,44 @@ _py_proc__deref_interp_head(py_proc_t* self) {
     }
 #endif
 
-    for (raddr_t current_addr = lower; current_addr <= upper; current_addr += sizeof(raddr_t)) {
-        if (py_proc__copy_v(self, runtime, current_addr, &runtime)) {
-            log_d("Cannot copy runtime state structure from remote address %p", current_addr);
-            continue; // GCOV_EXCL_LINE
-        }
+    // Otherwise, every candidate runtime state address gives us a candidate
+    // interpreter head, so we read all of them in one go and validate them in
+    // batches.
+    size_t   n     = (upper - lower) / sizeof(raddr_t) + 1;
+    cu_void* heads = malloc(n * sizeof(raddr_t));
+    if (!isvalid(heads)) { // GCOV_EXCL_START
+        set_error(MALLOC, "Cannot allocate memory for interpreter head candidates");
+        FAIL;
+    } // GCOV_EXCL_STOP
 
-        interp_head_raddr = V_FIELD(raddr_t, runtime, py_runtime, o_interp_head);
+    if (fail(py_proc__memcpy(self, lower + py_v->py_runtime.o_interp_head, n * sizeof(raddr_t), heads))) {
+        log_d("Cannot copy runtime state structure from remote address %p", lower);
+        FAIL;
+    }
 
-        if (fail(_py_proc__prefetch_interpreter_state(self, interp_head_raddr))) {
-            log_d("Failed to prefetch interpreter state from runtime state @ %p", interp_head_raddr);
-            interp_head_raddr = NULL; // GCOV_EXCL_LINE
-            continue;                 // GCOV_EXCL_LINE
-        }
+    for (size_t i = 0; i < n; i += INTERP_BATCH_SIZE) {
+        raddr_t candidates[INTERP_BATCH_SIZE];
+        size_t  m = n - i < INTERP_BATCH_SIZE ? n - i : INTERP_BATCH_SIZE;
 
-        if (fail(_py_proc__check_interp_state(self, interp_head_raddr))) {
-            log_d("Interpreter state check failed while dereferencing runtime state");
-            interp_head_raddr = NULL;
-            continue;
-        }
-    }
+        memcpy(candidates, (raddr_t*)heads + i, m * sizeof(raddr_t));
+        if (fail(_py_proc__filter_interp_states(self, candidates, &m)))
+            FAIL;
 
-    if (!isvalid(interp_head_raddr)) {
-        log_d("Cannot dereference PyInterpreterState head from runtime state");
-        FAIL;
-    }
+        for (size_t j = 0; j < m; j++) {
+            if (fail(_py_proc__prefetch_interpreter_state(self, candidates[j]))
+                || fail(_py_proc__check_interp_state(self, candidates[j]))) {
+                log_d("Interpreter state check failed while dereferencing runtime state");
+                continue;
+            }
 
-    self->istate_raddr = interp_head_raddr;
+            self->istate_raddr = candidates[j];
 
-    SUCCESS;
+            SUCCESS;
+        }
+    }
+
+    log_d("Cannot dereference PyInterpreterState head from runtime state");
+    FAIL;
 }
 
 // ----------------------------------------------------------------------------
@@ -622,13 +843,25 @@ _py_proc__find_interpreter_state(py_proc_t* self) {
         FAIL;
     } // GCOV_EXCL_STOP
 
+#ifdef DEBUG
+    microseconds_t t_start = gettime();
+#endif
+
     if (fail(_py_proc__init(self)))
         FAIL;
 
+#ifdef DEBUG
+    microseconds_t t_init = gettime();
+#endif
+
     // Determine and set version
     if (fail(_py_proc__infer_python_version(self)))
         FAIL;
 
+#ifdef DEBUG
+    microseconds_t t_version = gettime();
+#endif
+
     if (self->sym_loaded || isvalid(self->map.runtime.base)) {
         // Try to resolve the symbols or the runtime section, if we have them
 
@@ -650,6 +883,12 @@ _py_proc__find_interpreter_state(py_proc_t* self) {
         log_d("Interpreter state located from BSS scan (no symbols available)");
     }
 
+    log_d(
+        "Attach breakdown: init " MICROSECONDS_FMT " us, version " MICROSECONDS_FMT " us, interpreter state "
+        MICROSECONDS_FMT " us",
+        t_init - t_start, t_version - t_init, gettime() - t_version
+    );
+
     SUCCESS;
 }
 
@@ -680,7 +919,8 @@ py_proc__init(py_proc_t* self) {
 
     sfree(self->bin_path);
     sfree(self->lib_path);
-    self->sym_loaded = false;
+    self->sym_loaded  = false;
+    self->bin_version = 0;
 
     if (success(_py_proc__find_interpreter_state(self))) {
         init = true;
@@ -733,10 +973,6 @@ py_proc__init(py_proc_t* self) {
 
     self->timestamp = gettime();
 
-#ifdef NATIVE
-    self->unwind.as = unw_create_addr_space(&_UPT_accessors, 0);
-#endif
-
     V_DESC(self->py_v);
 
     size_t page_size = get_page_size();
@@ -818,11 +1054,35 @@ py_proc_new(bool child) {
     py_proc->interpreter_state_cache->name = "interpreter state cache";
 #endif
 
+    py_proc->stack_cache = lru_cache_new(MAX_STACK_CACHE_SIZE, (void (*)(value_t))py_stack__destroy);
+    if (!isvalid(py_proc->stack_cache)) { // GCOV_EXCL_START
+        FAIL_GOTO(error);
+    } // GCOV_EXCL_STOP
+#ifdef DEBUG
+    py_proc->stack_cache->name = "stack cache";
+#endif
+
     py_proc->extra = (proc_extra_info*)calloc(1, sizeof(proc_extra_info));
     if (!isvalid(py_proc->extra)) { // GCOV_EXCL_START
         set_error(MALLOC, "Cannot allocate memory for process extra info");
         FAIL_GOTO(error);
     } // GCOV_EXCL_STOP
+#if defined PL_LINUX
+    py_proc->extra->statm_fd = -1;
+#ifdef NATIVE
+    pthread_mutex_init(&py_proc->extra->wait_lock, NULL);
+    py_proc->extra->wait_status = -1;
+#endif
+
+    py_proc->extra->pthread_tid_cache = lru_cache_new(MAX_TID_CACHE_SIZE, free);
+    if (!isvalid(py_proc->extra->pthread_tid_cache)) { // GCOV_EXCL_START
+        free(py_proc->extra);
+        FAIL_GOTO(error);
+    } // GCOV_EXCL_STOP
+#ifdef DEBUG
+    py_proc->extra->pthread_tid_cache->name = "pthread TID cache";
+#endif
+#endif
 
     return py_proc;
 
@@ -1021,33 +1281,6 @@ py_proc__start(py_proc_t* self, const char* exec, char* argv[]) {
     SUCCESS;
 }
 
-// ----------------------------------------------------------------------------
-void
-py_proc__wait(py_proc_t* self) {
-    log_d("Waiting for process %d to terminate", self->pid);
-
-#if defined PL_LINUX
-    if (self->extra->wait_thread_id) {
-        pthread_join(self->extra->wait_thread_id, NULL);
-    }
-#endif
-
-#ifdef PL_WIN /* WIN */
-    if (isvalid(self->extra->h_reader_thread)) {
-        WaitForSingleObject(self->extra->h_reader_thread, INFINITE);
-        CloseHandle(self->extra->h_reader_thread);
-    }
-    WaitForSingleObject(self->ref, INFINITE);
-    CloseHandle(self->ref);
-#else /* UNIX */
-#ifdef NATIVE
-    wait(NULL);
-#else
-    waitpid(self->pid, 0, 0);
-#endif
-#endif
-}
-
 // ----------------------------------------------------------------------------
 #define PYRUNTIMESTATE_SIZE 2048 // We expect _PyRuntimeState to be < 2K.
 
@@ -1133,69 +1366,276 @@ py_proc__get_gc_state(py_proc_t* self) {
 }
 
 #ifdef NATIVE
+// ----------------------------------------------------------------------------
+static inline int
+_py_proc__add_stopped_thread(py_proc_t* self, pid_t tid) {
+    // A thread state that is being created or torn down might resolve to the
+    // TID of another thread. A thread stops only once, so we must not wait for
+    // it twice.
+    for (size_t i = 0; i < self->stopped.count; i++)
+        if (self->stopped.threads[i].tid == tid)
+            SUCCESS;
+
+    if (self->stopped.count == self->stopped.capacity) {
+        size_t            capacity = self->stopped.capacity ? self->stopped.capacity << 1 : 32;
+        stopped_thread_t* threads  = realloc(self->stopped.threads, capacity * sizeof(stopped_thread_t));
+        if (!isvalid(threads)) { // GCOV_EXCL_START
+            set_error(MALLOC, "Cannot allocate memory for stopped threads");
+            FAIL;
+        } // GCOV_EXCL_STOP
+        self->stopped.threads  = threads;
+        self->stopped.capacity = capacity;
+    }
+
+    self->stopped.threads[self->stopped.count++] = (stopped_thread_t){.tid = tid};
+
+    SUCCESS;
+}
+
+// ----------------------------------------------------------------------------
+// Take the stop of the main thread that the wait thread might have reaped
+// instead of us, if the process was started by us.
+static inline pid_t
+_py_proc__take_main_thread_stop(py_proc_t* self, int* status) {
+    pid_t pid = 0;
+
+    pthread_mutex_lock(&self->extra->wait_lock);
+    if (self->extra->wait_status != -1) {
+        *status                  = self->extra->wait_status;
+        self->extra->wait_status = -1;
+        pid                      = self->pid;
+    }
+    pthread_mutex_unlock(&self->extra->wait_lock);
+
+    return pid;
+}
+
+// ----------------------------------------------------------------------------
+// Wait for all the interrupted threads to stop. The interrupts have all been
+// sent by now, so the threads stop concurrently and we only wait for the
+// slowest one. Threads that do not stop in time are left to the retries of the
+// unwinder and of the resume step.
+static void
+_py_proc__wait_stopped_threads(py_proc_t* self) {
+    size_t         pending = self->stopped.count;
+    microseconds_t end     = gettime() + 100000; // Wait for 100ms
+
+    for (;;) {
+        for (size_t i = 0; i < self->stopped.count; i++) {
+            stopped_thread_t* thread = self->stopped.threads + i;
+            if (thread->stopped)
+                continue;
+
+            int   status;
+            pid_t pid = waitpid(thread->tid, &status, __WALL | WNOHANG);
+            if (pid == 0 && thread->tid == self->pid)
+                pid = _py_proc__take_main_thread_stop(self, &status);
+            if (pid == 0)
+                continue;
+
+            if (pid > 0 && WIFSTOPPED(status) && status >> 16 == 0) {
+                // A signal-delivery stop has precedence over the interrupt,
+                // which is still pending. We pass the signal on and wait for
+                // the thread to stop for the interrupt, or it would stop again
+                // as soon as we resume it.
+                if (success(ptrace(PTRACE_CONT, thread->tid, 0, (void*)(uintptr_t)WSTOPSIG(status))))
+                    continue;
+
+                // GCOV_EXCL_START
+                log_d("ptrace: failed to pass signal on to thread %d (errno: %d)", thread->tid, errno);
+                thread->signal = WSTOPSIG(status);
+                // GCOV_EXCL_STOP
+            }
+
+            thread->stopped = true;
+            pending--;
+
+            if (pid < 0) {
+                // The thread is gone and someone else has reaped it.
+                log_d("ptrace: cannot wait for thread %d (errno: %d)", thread->tid, errno);
+            } else if (!WIFSTOPPED(status)) {
+                log_d("ptrace: thread %d terminated", thread->tid);
+                thread->tid = 0;
+            }
+        }
+
+        if (pending == 0)
+            break;
+
+        if (gettime() >= end) { // GCOV_EXCL_START
+            log_d("ptrace: %ld threads did not stop in time", pending);
+            break;
+        } // GCOV_EXCL_STOP
+
+        sched_yield();
+    }
+}
+
+// ----------------------------------------------------------------------------
+static void
+_py_proc__stop_threads(py_proc_t* self) {
+    self->stopped.since = gettime();
+
+    for (size_t i = 0; i < self->stopped.count; i++) {
+        stopped_thread_t* thread = self->stopped.threads + i;
+        if (fail(ptrace(PTRACE_INTERRUPT, thread->tid, 0, 0))) {
+            // The thread might have just terminated.
+            log_d("ptrace: failed to interrupt thread %d (errno: %d)", thread->tid, errno);
+            thread->tid     = 0;
+            thread->stopped = true;
+            continue;
+        }
+        log_t("ptrace: thread %d interrupted", thread->tid);
+    }
+
+    _py_proc__wait_stopped_threads(self);
+}
+
 // ----------------------------------------------------------------------------
 static int
 _py_proc__interrupt_threads(py_proc_t* self, raddr_t tstate_head) {
     py_thread_t py_thread = py_thread__init(self);
 
+    self->stopped.count = 0;
+
     if (fail(py_thread__read_remote(&py_thread, tstate_head))) { // GCOV_EXCL_START
         FAIL;
     } // GCOV_EXCL_STOP
 
+    // Collect everything we need from the running threads first, so that they
+    // are kept stopped for as short as possible.
     do {
         if (pargs.kernel && fail(py_thread__save_kernel_stack(&py_thread))) // GCOV_EXCL_LINE
-            FAIL;                                                           // GCOV_EXCL_LINE
+            goto failed;                                                    // GCOV_EXCL_LINE
 
         // !IMPORTANT! We need to retrieve the idle state *before* trying to
         // interrupt the thread, else it will always be idle!
         if (fail(py_thread__set_idle(&py_thread))) // GCOV_EXCL_LINE
-            FAIL;                                  // GCOV_EXCL_LINE
-
-        if (fail(wait_ptrace(PTRACE_INTERRUPT, py_thread.tid, 0, 0))) // GCOV_EXCL_LINE
-            FAIL;                                                     // GCOV_EXCL_LINE
-
-        if (fail(py_thread__set_interrupted(&py_thread, true))) { // GCOV_EXCL_START
-            if (fail(wait_ptrace(PTRACE_CONT, py_thread.tid, 0, 0))) {
-                log_d("ptrace: failed to resume interrupted thread %d (errno: %d)", py_thread.tid, errno);
-            }
-            FAIL;
-        } // GCOV_EXCL_STOP
+            goto failed;                           // GCOV_EXCL_LINE
 
-        log_t("ptrace: thread %d interrupted", py_thread.tid);
+        if (fail(_py_proc__add_stopped_thread(self, py_thread.tid))) // GCOV_EXCL_LINE
+            goto failed;                                             // GCOV_EXCL_LINE
     } while (success(py_thread__next(&py_thread)));
 
     if (!error_is(ITEREND)) // GCOV_EXCL_LINE
-        FAIL;               // GCOV_EXCL_LINE
+        goto failed;        // GCOV_EXCL_LINE
+
+    _py_proc__stop_threads(self);
 
     SUCCESS;
-}
+
+failed: // GCOV_EXCL_START
+    // No thread has been interrupted yet, so there is nothing to resume.
+    self->stopped.count = 0;
+
+    FAIL;
+} // GCOV_EXCL_STOP
 
 // ----------------------------------------------------------------------------
+// Interrupt a single thread, for when threads are stopped one at a time. The
+// idle state of the thread must have been retrieved already.
 static int
-_py_proc__resume_threads(py_proc_t* self, raddr_t tstate_head) {
-    py_thread_t py_thread = py_thread__init(self);
+_py_proc__interrupt_thread(py_proc_t* self, py_thread_t* py_thread) {
+    self->stopped.count = 0;
 
-    if (fail(py_thread__read_remote(&py_thread, tstate_head))) { // GCOV_EXCL_START
-        FAIL;
-    } // GCOV_EXCL_STOP
+    if (pargs.kernel && fail(py_thread__save_kernel_stack(py_thread))) // GCOV_EXCL_LINE
+        FAIL;                                                          // GCOV_EXCL_LINE
 
-    do {
-        if (py_thread__is_interrupted(&py_thread)) {
-            if (fail(wait_ptrace(PTRACE_CONT, py_thread.tid, 0, 0))) // GCOV_EXCL_LINE
-                FAIL;                                                // GCOV_EXCL_LINE
+    if (fail(_py_proc__add_stopped_thread(self, py_thread->tid))) // GCOV_EXCL_LINE
+        FAIL;                                                     // GCOV_EXCL_LINE
 
-            log_t("ptrace: thread %d resumed", py_thread.tid);
-            if (fail(py_thread__set_interrupted(&py_thread, false))) { // GCOV_EXCL_START
-                FAIL;
-            } // GCOV_EXCL_STOP
-        }
-    } while (success(py_thread__next(&py_thread)));
+    _py_proc__stop_threads(self);
 
-    if (!error_is(ITEREND)) // GCOV_EXCL_LINE
-        FAIL;               // GCOV_EXCL_LINE
+    if (self->stopped.threads[0].tid == 0) {
+        self->stopped.count = 0;
+        set_error(OS, "Cannot interrupt thread");
+        FAIL;
+    }
 
     SUCCESS;
 }
+
+// ----------------------------------------------------------------------------
+static int
+_py_proc__resume_threads(py_proc_t* self) {
+    int outcome = 0;
+
+    for (size_t i = 0; i < self->stopped.count; i++) {
+        stopped_thread_t* thread = self->stopped.threads + i;
+        if (thread->tid == 0)
+            continue;
+
+        if (fail(wait_ptrace(PTRACE_CONT, thread->tid, 0, (void*)(uintptr_t)thread->signal))) { // GCOV_EXCL_START
+            log_d("ptrace: failed to resume thread %d (errno: %d)", thread->tid, errno);
+            outcome = 1;
+            continue;
+        } // GCOV_EXCL_STOP
+
+        log_t("ptrace: thread %d resumed", thread->tid);
+    }
+
+    if (self->stopped.count)
+        stats_stall_time(gettime() - self->stopped.since);
+
+    self->stopped.count = 0;
+
+    return outcome;
+}
+
+// ----------------------------------------------------------------------------
+// Stop tracing all the threads of the process, e.g. before waiting for it to
+// terminate. Any pending signals are delivered on detaching.
+static void
+_py_proc__detach_threads(py_proc_t* self) {
+    char task_path[32];
+    sprintf(task_path, "/proc/%d/task", self->pid);
+
+    cu_DIR* task_dir = opendir(task_path);
+    if (!isvalid(task_dir))
+        return;
+
+    self->stopped.count = 0;
+
+    struct dirent* ent;
+    while (isvalid(ent = readdir(task_dir))) {
+        pid_t tid = (pid_t)strtol(ent->d_name, NULL, 10);
+        if (tid <= 0 || !py_thread_is_seized(tid))
+            continue;
+
+        if (fail(_py_proc__add_stopped_thread(self, tid))) // GCOV_EXCL_LINE
+            break;                                         // GCOV_EXCL_LINE
+    }
+
+    if (self->stopped.count == 0)
+        return;
+
+    _py_proc__stop_threads(self);
+
+    for (size_t i = 0; i < self->stopped.count; i++) {
+        stopped_thread_t* thread = self->stopped.threads + i;
+        thread->stopped          = thread->tid == 0 || success(py_thread_detach(thread->tid, thread->signal));
+    }
+
+    // The threads that we could not detach from are likely exiting. We are
+    // still their tracer, so we have to reap them, or the process will not
+    // terminate. The main thread is reaped with the process.
+    microseconds_t end = gettime() + 100000; // Wait for 100ms
+    for (size_t i = 0; i < self->stopped.count; i++) {
+        stopped_thread_t* thread = self->stopped.threads + i;
+        if (thread->stopped || thread->tid == self->pid)
+            continue;
+
+        int   status;
+        pid_t pid;
+        while ((pid = waitpid(thread->tid, &status, __WALL | WNOHANG)) == 0 && gettime() < end)
+            sched_yield();
+
+        if (pid == thread->tid && WIFSTOPPED(status))
+            ptrace(PTRACE_DETACH, thread->tid, 0, 0);
+    }
+
+    self->stopped.count = 0;
+}
 #endif
 
 // ----------------------------------------------------------------------------
@@ -1238,7 +1678,10 @@ _py_proc__sample_interpreter(py_proc_t* self, raddr_t interp, microseconds_t tim
             if (fail(copy_datatype(self->ref, gil_state_raddr, gil_state))) // GCOV_EXCL_LINE
                 FAIL;                                                       // GCOV_EXCL_LINE
 
-            current_thread = (raddr_t)gil_state.last_holder._value;
+            // The last holder is kept after the GIL is released, e.g. around
+            // blocking calls. As with older versions, there is no current
+            // thread then, and the memory delta is left to the next holder.
+            current_thread = gil_state.locked._value ? (raddr_t)gil_state.last_holder._value : NULL;
         } else
             current_thread = _py_proc__current_thread_state(self);
     }
@@ -1308,6 +1751,13 @@ _py_proc__sample_interpreter(py_proc_t* self, raddr_t interp, microseconds_t tim
         if (mem_delta == 0 && time_delta == 0) // GCOV_EXCL_LINE
             continue;                          // GCOV_EXCL_LINE
 
+#ifdef NATIVE
+        // When threads are stopped one at a time, we retrieve the idle state
+        // here, as it must be done before the thread is interrupted.
+        if (pargs.per_thread && fail(py_thread__set_idle(&py_thread))) // GCOV_EXCL_LINE
+            FAIL;                                                      // GCOV_EXCL_LINE
+#endif
+
         bool is_idle = false;
         if (pargs.full || pargs.cpu || unlikely(pargs.where)) {
             is_idle = py_thread__is_idle(&py_thread);
@@ -1324,6 +1774,13 @@ _py_proc__sample_interpreter(py_proc_t* self, raddr_t interp, microseconds_t tim
             }
         }
 
+#ifdef NATIVE
+        if (pargs.per_thread && fail(_py_proc__interrupt_thread(self, &py_thread))) {
+            log_d("ptrace: skipping thread %ld", py_thread.tid);
+            continue;
+        }
+#endif
+
         sample_t sample = {
             .pid      = self->pid,
             .tid      = py_thread.tid,
@@ -1338,6 +1795,9 @@ _py_proc__sample_interpreter(py_proc_t* self, raddr_t interp, microseconds_t tim
         py_thread__unwind(&py_thread);
 
 #ifdef NATIVE
+        if (pargs.per_thread && fail(_py_proc__resume_threads(self))) // GCOV_EXCL_LINE
+            FAIL;                                                     // GCOV_EXCL_LINE
+
         if (V_MIN(3, 11) && V_MAX(3, 12)) {
             // We expect a CFrame to sit at the top of the stack
             if (!stack_is_empty() && stack_top() != CFRAME_MAGIC) { // GCOV_EXCL_START
@@ -1380,16 +1840,18 @@ py_proc__sample(py_proc_t* self) {
             SUCCESS;
 
 #ifdef NATIVE
-        if (fail(_py_proc__interrupt_threads(self, tstate_head))) // GCOV_EXCL_LINE
-            FAIL;                                                 // GCOV_EXCL_LINE
+        if (!pargs.per_thread) {
+            if (fail(_py_proc__interrupt_threads(self, tstate_head))) // GCOV_EXCL_LINE
+                FAIL;                                                 // GCOV_EXCL_LINE
 
-        time_delta = gettime() - self->timestamp;
+            time_delta = gettime() - self->timestamp;
+        }
 #endif
         int result = _py_proc__sample_interpreter(self, current_interp, time_delta);
 
 #ifdef NATIVE
-        if (fail(_py_proc__resume_threads(self, tstate_head))) // GCOV_EXCL_LINE
-            FAIL;                                              // GCOV_EXCL_LINE
+        if (!pargs.per_thread && fail(_py_proc__resume_threads(self))) // GCOV_EXCL_LINE
+            FAIL;                                                      // GCOV_EXCL_LINE
 #endif
 
         if (fail(result))
@@ -1483,6 +1945,55 @@ py_proc__signal(py_proc_t* self, int signal) {
 #endif
 }
 
+#ifdef NATIVE
+// ----------------------------------------------------------------------------
+int
+py_proc__refresh_vm_ranges(py_proc_t* self, raddr_t addr) {
+    if (!isvalid(self->extra->maps)) // GCOV_EXCL_LINE
+        FAIL;                        // GCOV_EXCL_LINE
+
+    // Addresses in anonymous memory, e.g. JIT code, will never be found in the
+    // table, so there is no point in re-reading the maps for them.
+    if (proc_maps__is_file_backed(self->extra->maps, (void*)addr) == 0)
+        FAIL;
+
+    return _py_proc__get_vm_maps(self);
+}
+#endif
+
+// ----------------------------------------------------------------------------
+void
+py_proc__wait(py_proc_t* self) {
+    log_d("Waiting for process %d to terminate", self->pid);
+
+#ifdef NATIVE
+    // The process cannot terminate while its threads are held in ptrace stops.
+    _py_proc__detach_threads(self);
+#endif
+
+#if defined PL_LINUX
+    if (self->extra->wait_thread_id) {
+        pthread_join(self->extra->wait_thread_id, NULL);
+        self->extra->wait_thread_id = 0;
+    }
+#endif
+
+#ifdef PL_WIN /* WIN */
+    if (isvalid(self->extra->h_reader_thread)) {
+        WaitForSingleObject(self->extra->h_reader_thread, INFINITE);
+        CloseHandle(self->extra->h_reader_thread);
+    }
+    WaitForSingleObject(self->ref, INFINITE);
+    CloseHandle(self->ref);
+#else /* UNIX */
+#ifdef NATIVE
+    wait(NULL);
+#else
+    waitpid(self->pid, 0, 0);
+#endif
+#endif
+}
+
 // ----------------------------------------------------------------------------
 void
 py_proc__terminate(py_proc_t* self) {
@@ -1496,9 +2007,11 @@ py_proc__destroy(py_proc_t* self) {
         return;         // GCOV_EXCL_LINE
 
 #ifdef NATIVE
-    unw_destroy_addr_space(self->unwind.as);
-    vm_range_tree__destroy(self->maps_tree);
-    hash_table__destroy(self->base_table);
+    py_thread_forget(self);
+    if (isvalid(self->unwind.as))
+        unw_destroy_addr_space(self->unwind.as);
+    vm_range_table__destroy(self->vm_ranges);
+    sfree(self->stopped.threads);
 #endif
 
 #if defined PL_MACOS
@@ -1508,12 +2021,30 @@ py_proc__destroy(py_proc_t* self) {
     sfree(self->bin_path);
     sfree(self->lib_path);
     sfree(self->interpreter_state_com.data);
+#if defined PL_LINUX
+    if (self->extra->wait_thread_id) {
+        // We are not waiting for the process to terminate, but the wait thread
+        // must not outlive the data it uses.
+        pthread_cancel(self->extra->wait_thread_id);
+        pthread_join(self->extra->wait_thread_id, NULL);
+    }
+#ifdef NATIVE
+    pthread_mutex_destroy(&self->extra->wait_lock);
+#endif
+    elf_file__close(self->extra->bin_elf);
+    elf_file__close(self->extra->lib_elf);
+    proc_maps__destroy(self->extra->maps);
+    if (self->extra->statm_fd != -1)
+        close(self->extra->statm_fd);
+    lru_cache__destroy(self->extra->pthread_tid_cache);
+#endif
     sfree(self->extra);
 
     lru_cache__destroy(self->string_cache);
     lru_cache__destroy(self->frame_cache);
     lru_cache__destroy(self->code_cache);
     lru_cache__destroy(self->interpreter_state_cache);
+    lru_cache__destroy(self->stack_cache);
 
     free(self);
 }
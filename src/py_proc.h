@@ -27,7 +27,7 @@
 
 #ifdef NATIVE
 #include "cache.h"
-#include "linux/vm-range-tree.h"
+#include "linux/vm-range-table.h"
 #include <libunwind-ptrace.h>
 #endif
 
@@ -37,6 +37,14 @@
 #include "stats.h"
 #include "version.h"
 
+#ifdef NATIVE
+typedef struct {
+    pid_t tid;
+    int   signal; // The signal to deliver on resume, if the thread stopped with one
+    bool  stopped;
+} stopped_thread_t;
+#endif
+
 typedef struct {
     raddr_t base;
     ssize_t size;
@@ -71,6 +79,9 @@ typedef struct {
     int       sym_loaded;
     python_v* py_v;
 
+    // Python version as found in the binary data, if any
+    int bin_version;
+
     raddr_t symbols[DYNSYM_COUNT]; // Binary symbols
 
     raddr_t gc_state_raddr;
@@ -81,6 +92,7 @@ typedef struct {
     lru_cache_t* string_cache;
     lru_cache_t* code_cache;
     lru_cache_t* interpreter_state_cache;
+    lru_cache_t* stack_cache; // The previous stack of each thread
 
     // Temporal profiling support
     microseconds_t timestamp;
@@ -95,8 +107,15 @@ typedef struct {
     struct _puw {
         unw_addr_space_t as;
     } unwind;
-    vm_range_tree_t* maps_tree;
-    hash_table_t*    base_table;
+    vm_range_table_t* vm_ranges;
+
+    // The threads that have been interrupted for the current sample
+    struct _pst {
+        stopped_thread_t* threads;
+        size_t            count;
+        size_t            capacity;
+        microseconds_t    since;
+    } stopped;
 #endif
 
     com_t interpreter_state_com;
@@ -243,6 +262,20 @@ py_proc__init(py_proc_t*);
 void
 py_proc__log_version(py_proc_t*, bool);
 
+#ifdef NATIVE
+/**
+ * Rebuild the VM range table if the memory maps of the process have changed.
+ * Call this when a look-up for the given address has missed.
+ *
+ * @param self  the process object.
+ * @param addr  the address that could not be resolved.
+ *
+ * @return 0 if the table is up-to-date; 1 otherwise.
+ */
+int
+py_proc__refresh_vm_ranges(py_proc_t*, raddr_t);
+#endif
+
 /**
  * Send a signal to the process.
  *
@@ -47,10 +47,42 @@
 
 static size_t max_pid = 0;
 #ifdef NATIVE
-static void**         _tids      = NULL;
-static unsigned char* _tids_idle = NULL;
-static unsigned char* _tids_int  = NULL;
-static char**         _kstacks   = NULL;
+#define MAX_STACK_FILE_SIZE 2048
+
+// The kernel stack of a thread. The procfs file is kept open and read again
+// into the same buffer on every sample.
+typedef struct {
+    int     fd;
+    ssize_t size;
+    char    buffer[MAX_STACK_FILE_SIZE];
+} kernel_stack_t;
+
+// The state of a thread that we have seized. Only a handful of the possible
+// TIDs are ever sampled, so the states are looked up by TID.
+typedef struct {
+    void*           context; // The libunwind context
+    kernel_stack_t* kstack;
+    bool            is_idle;
+} tid_state_t;
+
+static lookup_t* _tid_states = NULL;
+
+// ----------------------------------------------------------------------------
+static inline tid_state_t*
+_tid_state__get(uintptr_t tid) {
+    tid_state_t* state = lookup__get(_tid_states, (key_dt)tid);
+    if (isvalid(state))
+        return state;
+
+    state = (tid_state_t*)calloc(1, sizeof(tid_state_t));
+    if (!isvalid(state)) { // GCOV_EXCL_START
+        set_error(MALLOC, "Failed to allocate thread state");
+        FAIL_PTR;
+    } // GCOV_EXCL_STOP
+    lookup__set(_tid_states, (key_dt)tid, state);
+
+    return state;
+}
 #endif
 
 // ----------------------------------------------------------------------------
@@ -60,8 +92,13 @@ static char**         _kstacks   = NULL;
 #if defined(PL_LINUX)
 
 #include "linux/py_thread.h"
+#ifdef NATIVE
+#include "linux/symbol-index.h"
+#include "linux/unwind.h"
+#endif
 #if defined NATIVE && defined HAVE_BFD
 #include "linux/addr2line.h"
+#include "linux/symbolizer.h"
 #endif
 
 #elif defined(PL_WIN)
@@ -219,13 +256,97 @@ _py_thread__push_iframe(py_thread_t* self, raddr_t* prev) {
 } /* _py_thread__push_iframe */
 
 // ----------------------------------------------------------------------------
+// Scratch space for splicing frames, which is only ever grown.
+static void*    _splice_buffer      = NULL;
+static size_t   _splice_buffer_size = 0;
+static raddr_t* _splice_origins     = NULL;
+static bool*    _splice_ok          = NULL;
+static size_t   _splice_capacity    = 0;
+
+// Push the frames of the previous sample, starting from the one at the given
+// index, for as long as they still link to the same parent frame. All the
+// candidate frames are copied in one go, so the code object and instruction
+// that are pushed are always the current ones. On return, prev points to the
+// first frame that is still to be unwound.
 static inline int
-_py_thread__unwind_frame_stack(py_thread_t* self) {
+_py_thread__splice_frames(py_thread_t* self, py_stack_t* previous, size_t index, raddr_t* prev) {
+    V_DESC(self->proc->py_v);
+
+    size_t n    = previous->size - index;
+    size_t size = n * py_v->py_frame.size;
+    if (size > _splice_buffer_size) {
+        void* buffer = realloc(_splice_buffer, size);
+        if (!isvalid(buffer)) { // GCOV_EXCL_START
+            set_error(MALLOC, "Cannot allocate memory for frame batch");
+            FAIL;
+        } // GCOV_EXCL_STOP
+        _splice_buffer      = buffer;
+        _splice_buffer_size = size;
+    }
+    if (n > _splice_capacity) {
+        raddr_t* origins = (raddr_t*)realloc(_splice_origins, n * sizeof(raddr_t));
+        if (isvalid(origins))
+            _splice_origins = origins;
+        bool* ok = (bool*)realloc(_splice_ok, n * sizeof(bool));
+        if (isvalid(ok))
+            _splice_ok = ok;
+        if (!isvalid(origins) || !isvalid(ok)) { // GCOV_EXCL_START
+            set_error(MALLOC, "Cannot allocate memory for frame batch");
+            FAIL;
+        } // GCOV_EXCL_STOP
+        _splice_capacity = n;
+    }
+
+    raddr_t* origins = _splice_origins;
+    bool*    ok      = _splice_ok;
+    for (size_t i = 0; i < n; i++)
+        origins[i] = previous->frames[index + i].origin;
+
+    if (fail(copy_memory_batch(self->proc->ref, origins, n, py_v->py_frame.size, _splice_buffer, ok)))
+        FAIL;
+
+    for (size_t i = 0; i < n; i++) {
+        py_frame_t* expected = previous->frames + index + i;
+        void*       frame    = (char*)_splice_buffer + i * py_v->py_frame.size;
+        raddr_t     back     = V_FIELD_PTR(raddr_t, frame, py_frame, o_back);
+
+        if (!ok[i] || back != (i + 1 < n ? expected[1].origin : NULL) || stack_full())
+            break;
+
+        stack_py_push(
+            expected->origin, V_FIELD_PTR(raddr_t, frame, py_frame, o_code), V_FIELD_PTR(int, frame, py_frame, o_lasti)
+        );
+        *prev = back;
+    }
+
+    SUCCESS;
+}
+
+// ----------------------------------------------------------------------------
+static inline int
+_py_thread__unwind_frame_stack(py_thread_t* self, py_stack_t* previous) {
     stack_reset();
 
     raddr_t prev = self->top_frame;
 
+    // The frames at the bottom of the stack are likely the same as in the
+    // previous sample of this thread. Once we reach one of them, we try to
+    // validate them all at once.
+    bool splice = isvalid(previous);
+
     while (isvalid(prev)) {
+        ssize_t index = splice ? py_stack__find(previous, prev) : -1;
+        if (index >= 0) {
+            splice = false;
+            if (fail(_py_thread__splice_frames(self, previous, index, &prev)))
+                FAIL;
+            if (stack_has_cycle()) {
+                log_d("Circular frame reference detected");
+                FAIL;
+            }
+            continue;
+        }
+
         if (fail(_py_thread__push_remote_frame(self, &prev))) {
             log_d("Failed to retrieve frame #%d (from top).", stack_pointer());
             FAIL;
@@ -283,79 +404,104 @@ _py_thread__unwind_cframe_stack(py_thread_t* self) {
     return fail(_py_thread__unwind_iframe_stack(self, V_FIELD(raddr_t, cframe, py_cframe, o_current_frame)));
 }
 
-#ifdef NATIVE
 // ----------------------------------------------------------------------------
-int
-py_thread__set_idle(py_thread_t* self) {
-    unsigned char bit   = 1 << (self->tid & 7);
-    size_t        index = self->tid >> 3;
+static inline int
+_py_thread__read_stack_top(py_thread_t* self, py_stack_top_t* top) {
+    V_DESC(self->proc->py_v);
 
-    if (index > (max_pid >> 3)) { // GCOV_EXCL_START
-        set_error(OS, "Invalid thread identifier");
-        FAIL;
-    } // GCOV_EXCL_STOP
+    top->frame     = self->top_frame;
+    top->stack_top = self->stack_top;
 
-    if (py_thread__is_idle(self)) {
-        _tids_idle[index] |= bit;
-    } else {
-        _tids_idle[index] &= ~bit;
-    }
+    if (V_MIN(3, 11)) {
+        raddr_t origin = self->top_frame;
+        if (V_MAX(3, 12)) {
+            PyCFrame cframe;
+            if (fail(copy_py(self->proc->ref, self->top_frame, py_cframe, cframe)))
+                FAIL;
+            origin = V_FIELD(raddr_t, cframe, py_cframe, o_current_frame);
+        }
 
-    SUCCESS;
-}
+        V_ALLOCA(iframe, iframe);
 
-// ----------------------------------------------------------------------------
-int
-py_thread__set_interrupted(py_thread_t* self, bool state) {
-    unsigned char bit   = 1 << (self->tid & 7);
-    size_t        index = self->tid >> 3;
+        if (!isvalid(origin) || fail(copy_py(self->proc->ref, origin, py_iframe, iframe)))
+            FAIL;
 
-    if (state) {
-        _tids_int[index] |= bit;
+        top->origin = origin;
+        top->code   = V_FIELD(raddr_t, iframe, py_iframe, o_code);
+        top->back   = V_FIELD(raddr_t, iframe, py_iframe, o_previous);
+        top->lasti  = V_FIELD(raddr_t, iframe, py_iframe, o_prev_instr) - top->code;
     } else {
-        _tids_int[index] &= ~bit;
+        PyFrameObject frame;
+
+        if (fail(copy_remote_v(self->proc->ref, self->top_frame, frame, py_v->py_frame.size)))
+            FAIL;
+
+        top->origin = self->top_frame;
+        top->code   = V_FIELD(raddr_t, frame, py_frame, o_code);
+        top->back   = V_FIELD(raddr_t, frame, py_frame, o_back);
+        top->lasti  = V_FIELD(int, frame, py_frame, o_lasti);
     }
 
     SUCCESS;
 }
 
+#ifdef NATIVE
 // ----------------------------------------------------------------------------
 int
-py_thread__is_interrupted(py_thread_t* self) {
-    return _tids_int[self->tid >> 3] & (1 << (self->tid & 7));
+py_thread__set_idle(py_thread_t* self) {
+    tid_state_t* state = _tid_state__get(self->tid);
+    if (!isvalid(state)) // GCOV_EXCL_LINE
+        FAIL;            // GCOV_EXCL_LINE
+
+    // Read the actual state of the thread, as py_thread__is_idle only looks at
+    // the flag that we are updating here.
+    state->is_idle = _py_thread__stat_is_idle(self);
+
+    SUCCESS;
 }
 
 // ----------------------------------------------------------------------------
-#define MAX_STACK_FILE_SIZE 2048
-
 int
 py_thread__save_kernel_stack(py_thread_t* self) {
-    char stack_path[48];
-
-    if (!isvalid(_kstacks)) { // GCOV_EXCL_START
-        set_error(NULL, "Kernel stacks not initialized");
-        FAIL;
-    } // GCOV_EXCL_STOP
-
-    sfree(_kstacks[self->tid]);
+    tid_state_t* state = _tid_state__get(self->tid);
+    if (!isvalid(state)) // GCOV_EXCL_LINE
+        FAIL;            // GCOV_EXCL_LINE
+
+    kernel_stack_t* kstack = state->kstack;
+    if (!isvalid(kstack)) {
+        kstack = (kernel_stack_t*)malloc(sizeof(kernel_stack_t));
+        if (!isvalid(kstack)) { // GCOV_EXCL_START
+            set_error(MALLOC, "Failed to allocate kernel stack buffer");
+            FAIL;
+        } // GCOV_EXCL_STOP
+        kstack->fd    = -1;
+        kstack->size  = 0;
+        state->kstack = kstack;
+    }
 
-    sprintf(stack_path, "/proc/%d/task/%" PRIuPTR "/stack", self->proc->pid, self->tid);
-    cu_fd fd = open(stack_path, O_RDONLY);
-    if (fd == -1) { // GCOV_EXCL_START
-        set_error(IO, "Failed to open kernel stack file");
-        FAIL;
-    } // GCOV_EXCL_STOP
+    if (kstack->fd == -1) {
+        char stack_path[48];
 
-    _kstacks[self->tid] = (char*)calloc(1, MAX_STACK_FILE_SIZE);
-    if (!isvalid(_kstacks[self->tid])) { // GCOV_EXCL_START
-        set_error(MALLOC, "Failed to allocate kernel stack buffer");
-        FAIL;
-    } // GCOV_EXCL_STOP
+        sprintf(stack_path, "/proc/%d/task/%" PRIuPTR "/stack", self->proc->pid, self->tid);
+        kstack->fd = open(stack_path, O_RDONLY);
+        if (kstack->fd == -1) { // GCOV_EXCL_START
+            kstack->size = 0;
+            set_error(IO, "Failed to open kernel stack file");
+            FAIL;
+        } // GCOV_EXCL_STOP
+    }
 
-    if (read(fd, _kstacks[self->tid], MAX_STACK_FILE_SIZE) == -1) { // GCOV_EXCL_START
+    // Reading from the start regenerates the content of the file.
+    kstack->size = pread(kstack->fd, kstack->buffer, MAX_STACK_FILE_SIZE - 1, 0);
+    if (kstack->size == -1) { // GCOV_EXCL_START
+        // The thread might be gone, so we try to reopen the file next time.
+        close(kstack->fd);
+        kstack->fd   = -1;
+        kstack->size = 0;
         set_error(IO, "Failed to read kernel stack file");
         FAIL;
     } // GCOV_EXCL_STOP
+    kstack->buffer[kstack->size] = '\0';
 
     SUCCESS;
 }
@@ -363,30 +509,46 @@ py_thread__save_kernel_stack(py_thread_t* self) {
 // ----------------------------------------------------------------------------
 static inline int
 _py_thread__unwind_kernel_frame_stack(py_thread_t* self) {
-    char* line = _kstacks[self->tid];
-    if (!isvalid(line)) // GCOV_EXCL_LINE
-        SUCCESS;        // GCOV_EXCL_LINE
+    tid_state_t*    state  = lookup__get(_tid_states, (key_dt)self->tid);
+    kernel_stack_t* kstack = isvalid(state) ? state->kstack : NULL;
+
+    stack_kernel_reset();
+
+    if (!isvalid(kstack) || kstack->size <= 0) // GCOV_EXCL_LINE
+        SUCCESS;                               // GCOV_EXCL_LINE
 
     log_t("linux: unwinding kernel stack");
 
-    stack_kernel_reset();
+    lru_cache_t* string_cache = self->proc->string_cache;
 
-    for (;;) {
-        char* eol = strchr(line, '\n');
-        if (!isvalid(eol))
-            break;
+    // Each line looks like "[<0>] do_sys_poll+0x48a/0x590". The buffer is
+    // consumed in place, as it is refreshed on every sample.
+    for (char *line = kstack->buffer, *eol; !stack_kernel_full() && isvalid(eol = strchr(line, '\n')); line = eol + 1) {
         *eol = '\0';
 
         char* b = strchr(line, ']');
-        if (isvalid(b)) {
-            char* e = strchr(++b, '+');
-            if (isvalid(e))
-                *e = 0;
+        if (!isvalid(b) || b[1] == '\0')
+            continue;
 
-            stack_kernel_push(strdup(++b));
+        char* name = b + 2;
+        char* e    = strchr(name, '+');
+        if (isvalid(e))
+            *e = '\0';
+
+        key_dt           key   = (key_dt)string__hash(name);
+        cached_string_t* scope = lru_cache__maybe_hit(string_cache, key);
+        if (!isvalid(scope)) {
+            scope = cached_string_new(key, strdup(name));
+            if (!isvalid(scope)) {
+                FAIL; // GCOV_EXCL_LINE
+            }
+            lru_cache__store(string_cache, key, (value_t)scope);
+            event_handler__emit_new_string(scope);
         }
-        line = eol + 1;
+
+        stack_kernel_push(scope);
     }
+    kstack->size = 0;
 
     SUCCESS;
 }
@@ -405,40 +567,117 @@ wait_unw_init_remote(unw_cursor_t* c, unw_addr_space_t as, void* arg) {
     return outcome;
 }
 
+// ----------------------------------------------------------------------------
+// Find the symbol that contains the given PC in the symbol index of the module
+// that the PC belongs to. The index is loaded on first use.
+static inline symbol_t*
+_py_thread__native_symbol(py_thread_t* self, vm_range_t* range, unw_word_t pc, symbol_index_t** index, addr_t* vaddr) {
+    if (!isvalid(range->symbols))
+        range->symbols = vm_range__is_pseudo(range) ? &_no_symbol_index
+                                                    : symbol_index__get(self->proc->pid, range->name);
+
+    *index = range->symbols;
+    *vaddr = pc - range->base + (*index)->load_address;
+
+    return symbol_index__find(*index, *vaddr);
+}
+
+// ----------------------------------------------------------------------------
+// Whether the function that contains the given PC has already set up its frame
+// pointer, so that we can step to the caller without libunwind.
+static inline bool
+_py_thread__has_frame_pointer(py_thread_t* self, unw_word_t pc) {
+    if (!isvalid(self->proc->vm_ranges))
+        return false;
+
+    vm_range_t* range = vm_range_table__find(self->proc->vm_ranges, pc);
+    if (!isvalid(range))
+        return false;
+
+    symbol_index_t* index;
+    addr_t          vaddr;
+    symbol_t*       symbol = _py_thread__native_symbol(self, range, pc, &index, &vaddr);
+
+    return isvalid(symbol) && symbol->frame_setup > 0 && vaddr - symbol->start >= symbol->frame_setup;
+}
+
+// ----------------------------------------------------------------------------
+static inline int
+_py_thread__read_native_regs(unw_cursor_t* cursor, unw_word_t* pc, unw_word_t* sp, unw_word_t* bp) {
+    if (unw_get_reg(cursor, UNW_REG_IP, pc)) { // GCOV_EXCL_START
+        set_error(OS, "Failed to read program counter");
+        FAIL;
+    } // GCOV_EXCL_STOP
+
+#if defined __x86_64__
+    // The stack and frame pointers are only needed to follow frame pointers.
+    if (pargs.frame_pointers && (unw_get_reg(cursor, UNW_REG_SP, sp) || unw_get_reg(cursor, UNW_X86_64_RBP, bp)))
+        *sp = *bp = 0;
+#endif
+
+    SUCCESS;
+}
+
+// ----------------------------------------------------------------------------
+// Move the cursor to the frame reached by following frame pointers.
+static inline int
+_py_thread__seek_native_frame(
+    py_thread_t* self, void* context, unw_cursor_t* cursor, unw_word_t pc, unw_word_t sp, unw_word_t bp
+) {
+    if (!unwind__set_frame(pc, sp, bp) || unw_init_remote(cursor, self->proc->unwind.as, context))
+        FAIL;
+
+    SUCCESS;
+}
+
+// ----------------------------------------------------------------------------
 static inline int
 _py_thread__unwind_native_frame_stack(py_thread_t* self) {
     unw_cursor_t cursor;
-    unw_word_t   offset, pc;
+    unw_word_t   offset, pc, sp = 0, bp = 0;
+    bool         seeked = true; // Whether the cursor is at the current frame
 
     lru_cache_t* cache        = self->proc->frame_cache;
     lru_cache_t* string_cache = self->proc->string_cache;
-    void*        context      = _tids[self->tid];
+    tid_state_t* state        = _tid_state__get(self->tid);
 
     stack_native_reset();
 
-    if (!isvalid(context)) { // GCOV_EXCL_START
-        _tids[self->tid] = _UPT_create(self->tid);
-        if (!isvalid(_tids[self->tid])) {
+#ifdef HAVE_BFD
+    if (pargs.resolve)
+        symbolizer__drain(self->proc, cache, string_cache);
+#endif
+
+    if (!isvalid(state)) // GCOV_EXCL_LINE
+        FAIL;            // GCOV_EXCL_LINE
+
+    if (!isvalid(state->context)) { // GCOV_EXCL_START
+        state->context = _UPT_create(self->tid);
+        if (!isvalid(state->context)) {
             set_error(OS, "Failed to create libunwind context");
             FAIL;
         }
-        if (!isvalid(context)) {
-            set_error(OS, "Unexpected invalid context");
-            FAIL;
-        }
     } // GCOV_EXCL_STOP
+    void* context = state->context;
+
+    // The address space is created here, rather than with the process, as
+    // the accessors need the state of the current unwind.
+    if (!isvalid(self->proc->unwind.as)) {
+        self->proc->unwind.as = unwind_addr_space_new();
+        if (!isvalid(self->proc->unwind.as)) // GCOV_EXCL_LINE
+            FAIL;                            // GCOV_EXCL_LINE
+    }
+    unwind__begin(self->proc->pid, self->tid);
 
     if (fail(wait_unw_init_remote(&cursor, self->proc->unwind.as, context))) {
         set_error(OS, "Failed to initialize remote cursor");
         FAIL;
     }
 
-    do {
-        if (unw_get_reg(&cursor, UNW_REG_IP, &pc)) { // GCOV_EXCL_START
-            set_error(OS, "Failed to read program counter");
-            FAIL;
-        } // GCOV_EXCL_STOP
+    if (fail(_py_thread__read_native_regs(&cursor, &pc, &sp, &bp)))
+        FAIL;
 
+    for (bool innermost = true;; innermost = false) {
         key_dt frame_key = (key_dt)pc;
 
         frame_t* frame = lru_cache__maybe_hit(cache, frame_key);
@@ -446,26 +685,48 @@ _py_thread__unwind_native_frame_stack(py_thread_t* self) {
             cached_string_t* scope    = NULL;
             cached_string_t* filename = NULL;
             vm_range_t*      range    = NULL;
-            if (pargs.where) {
-                range = vm_range_tree__find(self->proc->maps_tree, pc);
-// TODO: A failed attempt to find a range is an indication that we need
-// to regenerate the VM maps. This would be of no use at the moment,
-// since we only use them in `where` mode where we sample just once. If
-// we resort to improving addr2line and use the VM range tree for
-// normal mode, then we should consider catching the case
-// !isvalid(range) and regenerate the VM range tree with fresh data.
+            if (isvalid(self->proc->vm_ranges)) {
+                range = vm_range_table__find(self->proc->vm_ranges, pc);
+                // A miss might be due to a new object having been mapped. In where
+                // mode the frame names borrow from the table, so we cannot rebuild
+                // it, but there we sample just once anyway.
+                if (!isvalid(range) && !pargs.where
+                    && success(py_proc__refresh_vm_ranges(self->proc, (raddr_t)pc)))
+                    range = vm_range_table__find(self->proc->vm_ranges, pc);
 #ifdef HAVE_BFD
-                if (isvalid(range)) {
-                    unw_word_t base = (unw_word_t)hash_table__get(self->proc->base_table, string__hash(range->name));
-                    if (base > 0)
-                        frame = get_native_frame(range->name, pc - base, frame_key);
-                }
+                if (pargs.where && isvalid(range) && range->base > 0 && !vm_range__is_pseudo(range))
+                    frame = get_native_frame(range->name, pc - range->base, frame_key);
 #endif
             }
             if (!isvalid(frame)) {
+                symbol_t* symbol = NULL;
+                if (isvalid(range)) {
+                    // Name the frame with a local look-up in the symbol index of
+                    // the module, without going through libunwind.
+                    symbol_index_t* index;
+                    addr_t          vaddr;
+
+                    symbol = _py_thread__native_symbol(self, range, pc, &index, &vaddr);
+                    if (isvalid(symbol)) {
+                        offset           = vaddr - symbol->start;
+                        key_dt scope_key = (key_dt)(pc - offset);
+                        scope            = lru_cache__maybe_hit(string_cache, scope_key);
+                        if (!isvalid(scope)) {
+                            scope = cached_string_new(scope_key, strdup(symbol_index__name(index, symbol)));
+                            if (!isvalid(scope)) {
+                                FAIL; // GCOV_EXCL_LINE
+                            }
+                            lru_cache__store(string_cache, scope_key, (value_t)scope);
+                            event_handler__emit_new_string(scope);
+                        }
+                    }
+                }
                 unw_proc_info_t pi;
-                if (success(unw_get_proc_info(&cursor, &pi))) {
+                if (!isvalid(symbol) && (seeked || success(_py_thread__seek_native_frame(self, context, &cursor, pc, sp, bp)))
+                    && success(unw_get_proc_info(&cursor, &pi))) {
+                    seeked           = true;
                     key_dt scope_key = (key_dt)pi.start_ip;
+                    offset           = pc - pi.start_ip;
                     scope            = lru_cache__maybe_hit(string_cache, scope_key);
                     if (!isvalid(scope)) {
                         if (unw_get_proc_name(&cursor, _native_buf, MAXLEN, &offset) == 0) {
@@ -483,11 +744,31 @@ _py_thread__unwind_native_frame_stack(py_thread_t* self) {
                     offset = 0;
                 }
 
-                if (isvalid(range)) { // For now this is only relevant in `where` mode
+                if (isvalid(range) && pargs.where) {
                     filename = cached_string_new((key_dt)pc, range->name);
                     if (!isvalid(filename)) {
                         FAIL; // GCOV_EXCL_LINE
                     }
+                } else if (isvalid(range) && pargs.resolve) {
+                    // Report the module, and the offset within it in place of
+                    // the line number, so that we only need one string per
+                    // module rather than one per PC.
+                    key_dt filename_key = string__hash(range->name);
+                    filename            = lru_cache__maybe_hit(string_cache, filename_key);
+                    if (!isvalid(filename)) {
+                        filename = cached_string_new(filename_key, strdup(range->name));
+                        if (!isvalid(filename)) {
+                            FAIL; // GCOV_EXCL_LINE
+                        }
+                        lru_cache__store(string_cache, filename_key, (value_t)filename);
+                        event_handler__emit_new_string(filename);
+                    }
+                    offset = pc - range->base;
+#ifdef HAVE_BFD
+                    // Have the source location resolved in the background.
+                    if (!vm_range__is_pseudo(range))
+                        symbolizer__submit(self->proc, frame_key, range->name, offset);
+#endif
                 } else {
                     // The program counter carries information about the file name *and*
                     // the line number. Given that we don't resolve the file name using
@@ -517,9 +798,34 @@ _py_thread__unwind_native_frame_stack(py_thread_t* self) {
 
             event_handler__emit_new_frame(frame);
         }
+#ifdef HAVE_BFD
+        else if (pargs.resolve)
+            symbolizer__retry(self->proc, frame);
+#endif
 
         stack_native_push(frame);
-    } while (!stack_native_full() && unw_step(&cursor) > 0);
+        if (stack_native_full())
+            break;
+
+        // The innermost frame might be in the prologue or epilogue of its
+        // function, so it is always left to libunwind.
+        if (pargs.frame_pointers && !innermost && _py_thread__has_frame_pointer(self, pc)
+            && unwind__fp_step(&pc, &sp, &bp)) {
+            seeked = false;
+            stats_count_native_step(true);
+            continue;
+        }
+
+        if (!seeked && fail(_py_thread__seek_native_frame(self, context, &cursor, pc, sp, bp)))
+            break;
+        if (unw_step(&cursor) <= 0)
+            break;
+        seeked = true;
+        if (fail(_py_thread__read_native_regs(&cursor, &pc, &sp, &bp)))
+            FAIL;
+        if (pargs.frame_pointers)
+            stats_count_native_step(false);
+    }
 
     SUCCESS;
 } /* _py_thread__unwind_native_frame_stack */
@@ -527,16 +833,26 @@ _py_thread__unwind_native_frame_stack(py_thread_t* self) {
 // ----------------------------------------------------------------------------
 static inline int
 _py_thread__seize(py_thread_t* self) {
+    // The TID might come from a thread state that is being torn down.
+    if (self->tid >= max_pid) {
+        set_error(OS, "Invalid TID detected");
+        FAIL;
+    }
+
+    tid_state_t* state = _tid_state__get(self->tid);
+    if (!isvalid(state)) // GCOV_EXCL_LINE
+        FAIL;            // GCOV_EXCL_LINE
+
     // TODO: If a TID is reused we will never seize it!
-    if (!isvalid(_tids[self->tid])) {
+    if (!isvalid(state->context)) {
         if (fail(wait_ptrace(PTRACE_SEIZE, self->tid, 0, 0))) { // GCOV_EXCL_START
             set_error(OS, "Failed to seize thread");
             FAIL;
         } else { // GCOV_EXCL_STOP
             log_d("ptrace: thread %d seized", self->tid);
         }
-        _tids[self->tid] = _UPT_create(self->tid);
-        if (!isvalid(_tids[self->tid])) { // GCOV_EXCL_START
+        state->context = _UPT_create(self->tid);
+        if (!isvalid(state->context)) { // GCOV_EXCL_START
             set_error(OS, "Failed to create libunwind context");
             FAIL;
         } // GCOV_EXCL_STOP
@@ -544,6 +860,26 @@ _py_thread__seize(py_thread_t* self) {
     SUCCESS;
 }
 
+// ----------------------------------------------------------------------------
+static inline void
+_tid_state__destroy(uintptr_t tid, tid_state_t* self) {
+    if (isvalid(self->context)) {
+        _UPT_destroy(self->context);
+        if (fail(wait_ptrace(PTRACE_DETACH, tid, 0, 0))) {
+            log_d("ptrace: failed to detach thread %ld", tid);
+        } else {
+            log_d("ptrace: thread %ld detached", tid);
+        }
+    }
+    if (isvalid(self->kstack)) {
+        if (self->kstack->fd != -1)
+            close(self->kstack->fd);
+        free(self->kstack);
+    }
+
+    free(self);
+}
+
 #endif /* NATIVE */
 
 // ---- PUBLIC ----------------------------------------------------------------
@@ -566,12 +902,11 @@ py_thread__read_remote(py_thread_t* self, raddr_t addr) {
         FAIL;
     }
 
-    self->stack = NULL;
-    if (V_MIN(3, 11)) {
-        // This is destroyed in py_thread__next, so it is important that all threads
-        // are traversed to avoid a memory leak!
-        self->stack = stack_chunk_new(proc->ref, V_FIELD(raddr_t, ts, py_thread, o_stack));
-    }
+    // The datastack chunk is only copied when the thread is unwound, so that we
+    // do not pay for it on threads that are skipped, e.g. idle ones.
+    self->stack      = NULL;
+    self->stack_addr = V_MIN(3, 11) ? V_FIELD(raddr_t, ts, py_thread, o_stack) : NULL;
+    self->stack_top  = V_MIN(3, 11) ? V_FIELD(raddr_t, ts, py_thread, o_stack_top) : NULL;
 
     self->addr      = addr;
     self->top_frame = V_FIELD(raddr_t, ts, py_thread, o_frame);
@@ -600,9 +935,8 @@ py_thread__read_remote(py_thread_t* self, raddr_t addr) {
                 FAIL;
             } // GCOV_EXCL_STOP
 #endif
-        } else if (likely(proc->extra->pthread_tid_offset) && success(read_pthread_t(self->proc, (void*)self->tid))) {
-            int o     = proc->extra->pthread_tid_offset;
-            self->tid = o > 0 ? proc->extra->_pthread_buffer[o] : (pid_t)((pid_t*)proc->extra->_pthread_buffer)[-o];
+        } else if (likely(proc->extra->pthread_tid_offset)
+                   && success(_py_thread__resolve_pthread_tid(self, V_FIELD(uint64_t, ts, py_thread, o_id)))) {
             if (self->tid >= max_pid || self->tid == 0) {
                 log_e("Invalid TID detected");
                 self->tid = 0;
@@ -663,7 +997,28 @@ py_thread__unwind(py_thread_t* self) {
     V_DESC(self->proc->py_v);
 
     if (isvalid(self->top_frame)) {
+        py_stack_t*    previous = lru_cache__maybe_hit(self->proc->stack_cache, (key_dt)self->tid);
+        py_stack_top_t top;
+        bool           has_top = false;
+
+#ifndef NATIVE
+        // An idle thread whose top frame has not moved since the last sample
+        // has the same stack as before, so we do not need to unwind it again.
+        has_top = success(_py_thread__read_stack_top(self, &top));
+        if (has_top && isvalid(previous) && py_stack_top__eq(&top, &previous->top) && py_thread__is_idle(self)) {
+            py_stack__restore(previous);
+            goto resolve;
+        }
+#endif
+
+        if (V_MIN(3, 11) && !isvalid(self->stack)) {
+            // This is destroyed in py_thread__next, so it is important that all threads
+            // are traversed to avoid a memory leak!
+            self->stack = stack_chunk_new(self->proc->ref, self->stack_addr, self->stack_top);
+        }
+
         if (V_MIN(3, 13)) {
+            stack_reset();
             if (fail(_py_thread__unwind_iframe_stack(self, self->top_frame))) {
                 error = true;
             }
@@ -672,11 +1027,29 @@ py_thread__unwind(py_thread_t* self) {
                 error = true;
             }
         } else {
-            if (fail(_py_thread__unwind_frame_stack(self))) {
+            if (fail(_py_thread__unwind_frame_stack(self, previous))) {
                 error = true;
             }
         }
 
+        if (!error) {
+            if (!isvalid(previous)) {
+                previous = (py_stack_t*)calloc(1, sizeof(py_stack_t));
+                if (isvalid(previous))
+                    lru_cache__store(self->proc->stack_cache, (key_dt)self->tid, (value_t)previous);
+            }
+            if (isvalid(previous) && success(py_stack__save(previous))) {
+                // Without a valid top the saved stack can only be spliced.
+                if (has_top)
+                    previous->top = top;
+                else
+                    previous->top = (py_stack_top_t){0};
+            }
+        }
+
+#ifndef NATIVE
+    resolve:
+#endif
         if (fail(_py_thread__resolve_py_stack(self))) {
             error = true;
         }
@@ -713,45 +1086,18 @@ py_thread_allocate(void) {
 
     max_pid = pid_max() + 1;
 
-#ifdef NATIVE
-    _tids = (void**)calloc(max_pid, sizeof(void*));
-    if (!isvalid(_tids)) { // GCOV_EXCL_START
-        set_error(MALLOC, "Failed to allocate thread context buffer");
-        goto failed;
-    } // GCOV_EXCL_STOP
-
-    size_t bmsize = (max_pid >> 3) + 1;
-
-    _tids_idle = (unsigned char*)calloc(bmsize, sizeof(unsigned char));
-    if (!isvalid(_tids_idle)) { // GCOV_EXCL_START
-        set_error(MALLOC, "Failed to allocate thread idle bitmap");
-        goto failed;
-    } // GCOV_EXCL_STOP
+#if defined PL_LINUX
+    if (fail(stat_files_allocate())) // GCOV_EXCL_LINE
+        FAIL;                        // GCOV_EXCL_LINE
+#endif
 
-    _tids_int = (unsigned char*)calloc(bmsize, sizeof(unsigned char));
-    if (!isvalid(_tids_int)) { // GCOV_EXCL_START
-        set_error(MALLOC, "Failed to allocate thread internal bitmap");
-        goto failed;
+#ifdef NATIVE
+    _tid_states = lookup_new(64);
+    if (!isvalid(_tid_states)) { // GCOV_EXCL_START
+        set_error(MALLOC, "Failed to allocate thread state table");
+        stat_files_free();
+        FAIL;
     } // GCOV_EXCL_STOP
-
-    if (pargs.kernel) {
-        _kstacks = (char**)calloc(max_pid, sizeof(char*));
-        if (!isvalid(_kstacks)) { // GCOV_EXCL_START
-            set_error(MALLOC, "Failed to allocate kernel stack buffer");
-            goto failed;
-        } // GCOV_EXCL_STOP
-    }
-    goto ok;
-
-failed: // GCOV_EXCL_START
-    sfree(_tids);
-    sfree(_tids_idle);
-    sfree(_tids_int);
-    sfree(_kstacks);
-
-    FAIL;
-
-ok:    // GCOV_EXCL_STOP
 #endif /* NATIVE */
 
     SUCCESS;
@@ -764,6 +1110,16 @@ py_thread_free(void) {
     sfree(_pi_buffer);
 #endif
 
+#if defined PL_LINUX
+    stat_files_free();
+#endif
+
+    sfree(_splice_buffer);
+    _splice_buffer_size = 0;
+    sfree(_splice_origins);
+    sfree(_splice_ok);
+    _splice_capacity = 0;
+
 #ifdef DEBUG
     if (_stack_chunk_count) {
         log_d(
@@ -776,22 +1132,69 @@ py_thread_free(void) {
     stack_deallocate();
 
 #ifdef NATIVE
-    for (pid_t tid = 0; tid < max_pid; tid++) {
-        if (isvalid(_tids[tid])) {
-            _UPT_destroy(_tids[tid]);
-            if (fail(wait_ptrace(PTRACE_DETACH, tid, 0, 0))) {
-                log_d("ptrace: failed to detach thread %ld", tid);
-            } else {
-                log_d("ptrace: thread %ld detached", tid);
-            }
-        }
-        if (isvalid(_kstacks) && isvalid(_kstacks[tid])) {
-            sfree(_kstacks[tid]);
+    if (isvalid(_tid_states)) {
+        lookup__iteritems_start(_tid_states, uintptr_t, tid, tid_state_t*, state) {
+            _tid_state__destroy(tid, state);
         }
+        lookup__iter_stop(_tid_states);
+        lookup__destroy(_tid_states);
+        _tid_states = NULL;
     }
-    sfree(_tids);
-    sfree(_tids_idle);
-    sfree(_tids_int);
-    sfree(_kstacks);
+    symbol_indices__destroy();
+    unwind__log_stats();
+#ifdef HAVE_BFD
+    symbolizer__stop();
+    bfd_files__destroy();
+#endif
+#endif
+}
+
+#ifdef NATIVE
+// ----------------------------------------------------------------------------
+void
+py_thread_forget(py_proc_t* py_proc) {
+#ifdef HAVE_BFD
+    symbolizer__discard(py_proc);
 #endif
 }
+
+// ----------------------------------------------------------------------------
+bool
+py_thread_is_seized(uintptr_t tid) {
+    if (!isvalid(_tid_states))
+        return false;
+
+    tid_state_t* state = lookup__get(_tid_states, (key_dt)tid);
+    return isvalid(state) && isvalid(state->context);
+}
+
+// ----------------------------------------------------------------------------
+int
+py_thread_detach(uintptr_t tid, int signal) {
+    if (!isvalid(_tid_states))
+        SUCCESS;
+
+    tid_state_t* state = lookup__get(_tid_states, (key_dt)tid);
+    if (!isvalid(state))
+        SUCCESS;
+
+    int outcome = 0;
+
+    if (isvalid(state->context)) {
+        _UPT_destroy(state->context);
+        state->context = NULL;
+
+        if (fail(ptrace(PTRACE_DETACH, tid, 0, (void*)(uintptr_t)signal))) {
+            log_d("ptrace: failed to detach thread %ld (errno: %d)", tid, errno);
+            outcome = 1;
+        } else {
+            log_d("ptrace: thread %ld detached", tid);
+        }
+    }
+
+    lookup__del(_tid_states, (key_dt)tid);
+    _tid_state__destroy(tid, state);
+
+    return outcome;
+}
+#endif
@@ -46,6 +46,8 @@ typedef struct thread {
     raddr_t top_frame;
 
     /* The per-thread datastack was introduced in Python 3.11 */
+    raddr_t        stack_addr;
+    raddr_t        stack_top;
     stack_chunk_t* stack;
 
     tstate_status_t status;
@@ -96,14 +98,39 @@ void
 py_thread_free(void);
 
 #ifdef NATIVE
-int
-py_thread__set_idle(py_thread_t*);
+/**
+ * Discard any state that the unwinder keeps on behalf of a process, e.g. the
+ * native frames still being symbolised, before the process is destroyed.
+ *
+ * @param py_proc_t  the process that is going away.
+ */
+void
+py_thread_forget(py_proc_t*);
 
+/**
+ * Check whether a thread is being traced by us.
+ *
+ * @param tid  the TID of the thread.
+ *
+ * @return true if the thread has been seized.
+ */
+bool
+py_thread_is_seized(uintptr_t);
+
+/**
+ * Stop tracing a thread that is in a ptrace stop, and forget its state.
+ *
+ * @param tid     the TID of the thread.
+ * @param signal  the signal to deliver to the thread on detaching, if any.
+ *
+ * @return 0 on success, 1 if the thread could not be detached, e.g. because
+ *         it is exiting.
+ */
 int
-py_thread__set_interrupted(py_thread_t*, bool);
+py_thread_detach(uintptr_t, int);
 
 int
-py_thread__is_interrupted(py_thread_t* self);
+py_thread__set_idle(py_thread_t*);
 
 int
 py_thread__save_kernel_stack(py_thread_t*);
@@ -50,9 +50,16 @@ stack_allocate(size_t size) {
     _stack->size    = size;
     _stack->base    = (frame_t**)calloc(size, sizeof(frame_t*));
     _stack->py_base = (py_frame_t*)calloc(size, sizeof(py_frame_t));
+
+    size_t n_origins = 1;
+    while (n_origins < size << 1)
+        n_origins <<= 1;
+    _stack->origins      = (stack_origin_t*)calloc(n_origins, sizeof(stack_origin_t));
+    _stack->origins_mask = n_origins - 1;
+    _stack->generation   = 1;
 #ifdef NATIVE
     _stack->native_base = (frame_t**)calloc(size, sizeof(frame_t*));
-    _stack->kernel_base = (char**)calloc(size, sizeof(char*));
+    _stack->kernel_base = (cached_string_t**)calloc(size, sizeof(cached_string_t*));
 #endif
 
     SUCCESS;
@@ -65,10 +72,20 @@ stack_deallocate(void) {
 
     free(_stack->base);
     free(_stack->py_base);
+    free(_stack->origins);
 #ifdef NATIVE
     free(_stack->native_base);
     free(_stack->kernel_base);
 #endif
 
     free(_stack);
+    _stack = NULL;
+
+    while (isvalid(_stack_chunk_pool)) {
+        stack_chunk_t* chunk = _stack_chunk_pool;
+        _stack_chunk_pool    = chunk->previous;
+
+        sfree(chunk->data);
+        free(chunk);
+    }
 }
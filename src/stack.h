@@ -22,8 +22,11 @@
 
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "cache.h"
 #include "frame.h"
@@ -34,17 +37,31 @@
 #include "python/misc.h"
 #include "version.h"
 
+typedef struct {
+    raddr_t      origin;
+    unsigned int generation;
+} stack_origin_t;
+
 typedef struct {
     size_t      size;
     frame_t**   base;
     ssize_t     pointer;
     py_frame_t* py_base;
+
+    // The origins of the frames on the stack, for detecting cycles. This is an
+    // open-addressed hash set with at least twice as many slots as the stack
+    // can hold. Slots from previous stacks are told apart by their generation,
+    // so that the set can be emptied in constant time.
+    stack_origin_t* origins;
+    size_t          origins_mask;
+    unsigned int    generation;
+    bool            has_cycle;
 #ifdef NATIVE
     frame_t** native_base;
     ssize_t   native_pointer;
 
-    char**  kernel_base;
-    ssize_t kernel_pointer;
+    cached_string_t** kernel_base;
+    ssize_t           kernel_pointer;
 #endif
 } stack_dt;
 
@@ -63,27 +80,49 @@ stack_deallocate(void);
 
 static inline bool
 stack_has_cycle(void) {
-    if (_stack->pointer < 2)
-        return false;
-
-    // This sucks! :( Worst case is quadratic in the stack height, but if the
-    // sampled stacks are short on average, it might still be faster than the
-    // overhead introduced by looking up from a set-like data structure.
-    py_frame_t top = _stack->py_base[_stack->pointer - 1];
-    for (ssize_t i = _stack->pointer - 2; i >= 0; i--) {
-#ifdef NATIVE
-        if (top.origin == _stack->py_base[i].origin && top.origin != CFRAME_MAGIC)
-#else
-        if (top.origin == _stack->py_base[i].origin)
-#endif
-            return true;
+    return _stack->has_cycle;
+}
+
+#define stack_origin_hash(origin) ((size_t)(((uintptr_t)(origin) * 0x9E3779B97F4A7C15ULL) >> 32))
+
+static inline void
+_stack_origins__add(raddr_t origin) {
+    size_t i = stack_origin_hash(origin) & _stack->origins_mask;
+
+    for (;; i = (i + 1) & _stack->origins_mask) {
+        stack_origin_t* slot = _stack->origins + i;
+        if (slot->generation != _stack->generation) {
+            slot->origin     = origin;
+            slot->generation = _stack->generation;
+            return;
+        }
+        if (slot->origin == origin) {
+            _stack->has_cycle = true;
+            return;
+        }
     }
-    return false;
 }
 
 static inline void
 stack_py_push(raddr_t origin, raddr_t code, int lasti) {
     _stack->py_base[_stack->pointer++] = (py_frame_t){.origin = origin, .code = code, .lasti = lasti};
+
+#ifdef NATIVE
+    if (origin == CFRAME_MAGIC)
+        return;
+#endif
+    _stack_origins__add(origin);
+}
+
+static inline void
+stack_reset(void) {
+    _stack->pointer   = 0;
+    _stack->has_cycle = false;
+
+    if (++_stack->generation == 0) {
+        memset(_stack->origins, 0, (_stack->origins_mask + 1) * sizeof(stack_origin_t));
+        _stack->generation = 1;
+    }
 }
 
 #define stack_pointer() (_stack->pointer)
@@ -95,8 +134,6 @@ stack_py_push(raddr_t origin, raddr_t code, int lasti) {
 #define stack_py_pop()  (_stack->py_base[--_stack->pointer])
 #define stack_py_get(i) (_stack->py_base[i])
 #define stack_top()     (_stack->pointer ? _stack->base[_stack->pointer - 1] : NULL)
-#define stack_reset()        \
-    { _stack->pointer = 0; }
 #define stack_is_valid() (_stack->base[_stack->pointer - 1]->line != 0)
 #define stack_is_empty() (_stack->pointer == 0)
 #define stack_full()     (_stack->pointer >= _stack->size)
@@ -123,6 +160,142 @@ stack_py_push(raddr_t origin, raddr_t code, int lasti) {
 
 // ----------------------------------------------------------------------------
 
+// The Python frames of the last sample of a thread, from the top down, with an
+// index of their origins. This allows the frames at the bottom of the stack,
+// which do not normally change between samples, to be validated in one go,
+// rather than read one by one.
+typedef struct {
+    raddr_t      origin;
+    unsigned int index; // The index of the frame, plus one
+} py_stack_origin_t;
+
+// What the top of the stack of a thread looked like when its frames were
+// saved. If nothing has changed by the next sample, and the thread is idle,
+// the saved frames can be reused as they are.
+typedef struct {
+    raddr_t frame;     // The frame pointer of the thread state
+    raddr_t stack_top; // The top of the datastack (3.11+)
+    raddr_t origin;    // The topmost frame
+    raddr_t code;
+    raddr_t back;
+    int     lasti;
+} py_stack_top_t;
+
+static inline bool
+py_stack_top__eq(py_stack_top_t* self, py_stack_top_t* other) {
+    return self->frame == other->frame && self->stack_top == other->stack_top && self->origin == other->origin
+        && self->code == other->code && self->back == other->back && self->lasti == other->lasti;
+}
+
+typedef struct {
+    size_t             size;
+    size_t             capacity;
+    py_frame_t*        frames;
+    py_stack_origin_t* origins;
+    size_t             origins_mask;
+    py_stack_top_t     top;
+} py_stack_t;
+
+// ----------------------------------------------------------------------------
+static inline void
+py_stack__destroy(py_stack_t* self) {
+    if (!isvalid(self))
+        return;
+
+    sfree(self->frames);
+    sfree(self->origins);
+
+    free(self);
+}
+
+// ----------------------------------------------------------------------------
+/**
+ * Save the Python frames currently on the stack.
+ *
+ * @param self  the previous stack of a thread
+ *
+ * @return 0 on success, 1 otherwise.
+ */
+static inline int
+py_stack__save(py_stack_t* self) {
+    size_t size = stack_pointer();
+
+    if (size > self->capacity || !isvalid(self->frames)) {
+        size_t capacity = self->capacity ? self->capacity : 64;
+        while (capacity < size)
+            capacity <<= 1;
+
+        sfree(self->frames);
+        sfree(self->origins);
+        self->capacity = 0;
+
+        self->frames  = (py_frame_t*)malloc(capacity * sizeof(py_frame_t));
+        self->origins = (py_stack_origin_t*)malloc((capacity << 1) * sizeof(py_stack_origin_t));
+        if (!isvalid(self->frames) || !isvalid(self->origins)) { // GCOV_EXCL_START
+            sfree(self->frames);
+            sfree(self->origins);
+            self->size = 0;
+            set_error(MALLOC, "Cannot allocate memory for previous stack");
+            FAIL;
+        } // GCOV_EXCL_STOP
+        self->capacity     = capacity;
+        self->origins_mask = (capacity << 1) - 1;
+    }
+
+    memcpy(self->frames, _stack->py_base, size * sizeof(py_frame_t));
+    memset(self->origins, 0, (self->origins_mask + 1) * sizeof(py_stack_origin_t));
+    for (size_t i = 0; i < size; i++) {
+        size_t h = stack_origin_hash(self->frames[i].origin) & self->origins_mask;
+        while (self->origins[h].index)
+            h = (h + 1) & self->origins_mask;
+        self->origins[h].origin = self->frames[i].origin;
+        self->origins[h].index  = i + 1;
+    }
+    self->size = size;
+
+    SUCCESS;
+}
+
+// ----------------------------------------------------------------------------
+/**
+ * Put the saved Python frames back on the stack.
+ *
+ * @param self  the previous stack of a thread
+ */
+static inline void
+py_stack__restore(py_stack_t* self) {
+    stack_reset();
+
+    memcpy(_stack->py_base, self->frames, self->size * sizeof(py_frame_t));
+    _stack->pointer = self->size;
+}
+
+// ----------------------------------------------------------------------------
+/**
+ * Find the frame with the given origin in the previous stack.
+ *
+ * @param self    the previous stack of a thread
+ * @param origin  the remote address of the frame
+ *
+ * @return the index of the frame, or -1 if the previous stack does not have a
+ *         frame with the given origin.
+ */
+static inline ssize_t
+py_stack__find(py_stack_t* self, raddr_t origin) {
+    if (self->size == 0)
+        return -1;
+
+    for (size_t h = stack_origin_hash(origin) & self->origins_mask; self->origins[h].index;
+         h     = (h + 1) & self->origins_mask) {
+        if (self->origins[h].origin == origin)
+            return self->origins[h].index - 1;
+    }
+
+    return -1;
+}
+
+// ----------------------------------------------------------------------------
+
 // Support for datastack_chunk. This thread data was introduced in CPython 3.11
 // and is used to store per-thread interpreter frame objects. Support for these
 // chunks of memory allows us to copy all the frame objects in one go, thus
@@ -130,76 +303,152 @@ stack_py_push(raddr_t origin, raddr_t code, int lasti) {
 // We expect that an added benefit of this is also a reduced error rate and
 // higher overall accuracy.
 
-// This is our representation of the linked list of stack chunks
+// This is our representation of the linked list of stack chunks. Only the
+// part of a chunk that is in use is copied, that is up to the top of the
+// datastack for the current chunk, and up to the saved top for the previous
+// ones. The structures and their buffers are recycled through a pool, so that
+// in steady state no allocations are needed to copy the datastack.
 typedef struct stack_chunk {
     raddr_t             origin;
     _PyStackChunk*      data;
+    size_t              size;     // The number of bytes copied
+    size_t              capacity; // The size of the local buffer
     struct stack_chunk* previous;
 } stack_chunk_t;
 
+// Chunks larger than this are assumed to come from a corrupted thread state.
+#define MAX_STACK_CHUNK_SIZE (1 << 24)
+
+#ifndef STACK_C
+extern
+#endif
+    stack_chunk_t* _stack_chunk_pool;
+
 // ----------------------------------------------------------------------------
 static inline stack_chunk_t*
-stack_chunk_new(proc_ref_t pref, raddr_t origin) {
-    _PyStackChunk original_chunk = {0};
+_stack_chunk__get(size_t size) {
+    stack_chunk_t* chunk = _stack_chunk_pool;
+    if (isvalid(chunk)) {
+        _stack_chunk_pool = chunk->previous;
+    } else {
+        chunk = (stack_chunk_t*)calloc(1, sizeof(stack_chunk_t));
+        if (!isvalid(chunk)) { // GCOV_EXCL_START
+            set_error(MALLOC, "Cannot allocate memory for stack chunk");
+            FAIL_PTR;
+        } // GCOV_EXCL_STOP
+    }
+    chunk->previous = NULL;
+
+    if (chunk->capacity < size) {
+        // Grow geometrically to settle on the final size quickly.
+        size_t capacity = chunk->capacity ? chunk->capacity : sizeof(_PyStackChunk);
+        while (capacity < size)
+            capacity <<= 1;
+
+        void* data = realloc(chunk->data, capacity);
+        if (!isvalid(data)) { // GCOV_EXCL_START
+            chunk->previous   = _stack_chunk_pool;
+            _stack_chunk_pool = chunk;
+            set_error(MALLOC, "Cannot allocate memory for stack chunk data");
+            FAIL_PTR;
+        } // GCOV_EXCL_STOP
+        chunk->data     = (_PyStackChunk*)data;
+        chunk->capacity = capacity;
+    }
 
-    if (!isvalid(origin)) {
-        set_error(NULL, "Invalid origin address for stack chunk");
-        FAIL_PTR;
+    return chunk;
+}
+
+// ----------------------------------------------------------------------------
+/**
+ * Return the chunks of a datastack copy to the pool.
+ *
+ * @param chunk  the datastack copy
+ */
+static inline void
+stack_chunk__destroy(stack_chunk_t* chunk) {
+    while (isvalid(chunk)) {
+        stack_chunk_t* previous = chunk->previous;
+
+        chunk->previous   = _stack_chunk_pool;
+        _stack_chunk_pool = chunk;
+
+        chunk = previous;
     }
+}
 
-    if (copy_datatype(pref, origin, original_chunk))
+// ----------------------------------------------------------------------------
+static inline stack_chunk_t*
+_stack_chunk__copy(proc_ref_t pref, raddr_t origin, size_t size) {
+    if (size < offsetof(_PyStackChunk, data) || size > MAX_STACK_CHUNK_SIZE) {
+        set_error(PYOBJECT, "Invalid stack chunk size");
         FAIL_PTR;
+    }
 
-    stack_chunk_t* chunk = (stack_chunk_t*)calloc(1, sizeof(stack_chunk_t));
-    if (!isvalid(chunk)) { // GCOV_EXCL_START
-        set_error(MALLOC, "Cannot allocate memory for stack chunk");
+    stack_chunk_t* chunk = _stack_chunk__get(size);
+    if (!isvalid(chunk)) // GCOV_EXCL_LINE
+        FAIL_PTR;        // GCOV_EXCL_LINE
+
+    if (fail(copy_memory(pref, origin, size, chunk->data)) || chunk->data->size < size) {
+        stack_chunk__destroy(chunk);
+        set_error(PYOBJECT, "Cannot copy stack chunk");
         FAIL_PTR;
-    } // GCOV_EXCL_STOP
+    }
 
-    chunk->data = (_PyStackChunk*)malloc(original_chunk.size);
-    if (!isvalid(chunk->data)) { // GCOV_EXCL_START
-        set_error(MALLOC, "Cannot allocate memory for stack chunk data");
-        FAIL_GOTO(fail);
-    } // GCOV_EXCL_STOP
+    chunk->origin = origin;
+    chunk->size   = size;
 
-    if (copy_memory(pref, origin, original_chunk.size, chunk->data)) { // GCOV_EXCL_START
-        FAIL_GOTO(fail);
-    } // GCOV_EXCL_STOP
+    return chunk;
+}
 
-    chunk->origin = origin;
+// ----------------------------------------------------------------------------
+/**
+ * Copy the datastack of a thread.
+ *
+ * @param pref    the process reference
+ * @param origin  the remote address of the current chunk
+ * @param top     the remote address of the top of the datastack
+ *
+ * @return a valid reference to the local copy of the datastack, NULL on
+ *         failure.
+ */
+static inline stack_chunk_t*
+stack_chunk_new(proc_ref_t pref, raddr_t origin, raddr_t top) {
+    if (!isvalid(origin) || top < origin) {
+        set_error(NULL, "Invalid origin address for stack chunk");
+        FAIL_PTR;
+    }
 
-    if (original_chunk.previous != NULL) { // GCOV_EXCL_START
-        chunk->previous = stack_chunk_new(pref, original_chunk.previous);
-        if (!isvalid(chunk->previous)) {
-            FAIL_GOTO(fail);
-        }
-    } // GCOV_EXCL_STOP
+    stack_chunk_t* chunk = _stack_chunk__copy(pref, origin, (char*)top - (char*)origin);
+    if (!isvalid(chunk))
+        FAIL_PTR;
+
+    // The frames in the previous chunks are still live, so we copy them too.
+    // CPython saves the top of a chunk when it pushes a new one.
+    for (stack_chunk_t* current = chunk; isvalid(current->data->previous); current = current->previous) {
+        _PyStackChunk header = {0};
+        if (fail(copy_datatype(pref, current->data->previous, header))) // GCOV_EXCL_LINE
+            FAIL_GOTO(fail);                                            // GCOV_EXCL_LINE
+
+        current->previous = _stack_chunk__copy(
+            pref, current->data->previous, offsetof(_PyStackChunk, data) + header.top * sizeof(PyObject*)
+        );
+        if (!isvalid(current->previous)) // GCOV_EXCL_LINE
+            FAIL_GOTO(fail);             // GCOV_EXCL_LINE
+    }
 
     return chunk;
 
 fail: // GCOV_EXCL_START
-    sfree(chunk->data);
-    sfree(chunk);
+    stack_chunk__destroy(chunk);
 
     return NULL;
 } // GCOV_EXCL_STOP
 
-// ----------------------------------------------------------------------------
-static inline void
-stack_chunk__destroy(stack_chunk_t* chunk) {
-    if (!isvalid(chunk))
-        return;
-
-    sfree(chunk->data);
-    stack_chunk__destroy(chunk->previous);
-
-    free(chunk);
-}
-
 // ----------------------------------------------------------------------------
 static inline void*
 stack_chunk__resolve(stack_chunk_t* self, raddr_t address) {
-    if (address >= self->origin && (char*)address < (char*)self->origin + self->data->size)
+    if (address >= self->origin && (char*)address < (char*)self->origin + self->size)
         return (char*)self->data + ((char*)address - (char*)self->origin);
 
     if (self->previous)                                       // GCOV_EXCL_LINE
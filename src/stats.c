@@ -63,6 +63,15 @@ ustat_t _long_cnt;
 
 microseconds_t _gc_time;
 
+#ifdef NATIVE
+ustat_t _fp_step_cnt;
+ustat_t _unw_step_cnt;
+
+ustat_t        _stall_cnt;
+microseconds_t _stall_time;
+microseconds_t _max_stall_time;
+#endif
+
 #if defined PL_MACOS
 static clock_serv_t cclock;
 #elif defined PL_WIN
@@ -96,6 +105,15 @@ stats_reset() {
     _sample_cnt = 0;
     _error_cnt  = 0;
 
+#ifdef NATIVE
+    _fp_step_cnt  = 0;
+    _unw_step_cnt = 0;
+
+    _stall_cnt      = 0;
+    _stall_time     = 0;
+    _max_stall_time = 0;
+#endif
+
     _min_sampling_time = MICROSECONDS_MAX;
     _max_sampling_time = 0;
     _avg_sampling_time = 0;
@@ -154,6 +172,14 @@ stats_log_metrics() {
         event_handler__emit_metadata("errors", "%ld/%ld", _error_cnt, _sample_cnt);
         if (pargs.gc)
             event_handler__emit_metadata("gc", MICROSECONDS_FMT, _gc_time);
+#ifdef NATIVE
+        if (pargs.frame_pointers)
+            event_handler__emit_metadata("unwind", "%ld/%ld", _fp_step_cnt, _fp_step_cnt + _unw_step_cnt);
+        if (_stall_cnt)
+            event_handler__emit_metadata(
+                "stall", MICROSECONDS_FMT "," MICROSECONDS_FMT, _stall_time / _stall_cnt, _max_stall_time
+            );
+#endif
 
         if (pargs.pipe)
             goto release; // Saves a few computations
@@ -184,6 +210,24 @@ stats_log_metrics() {
             );
         }
 
+#ifdef NATIVE
+        if (pargs.frame_pointers && _fp_step_cnt + _unw_step_cnt) {
+            log_m(
+                STAT_INDENT "Frame pointer steps" BLK "  . . . " CRESET BOLD "%ld/%ld" CRESET " (" BOLD "%.2f%%" CRESET
+                            ")",
+                _fp_step_cnt, _fp_step_cnt + _unw_step_cnt, (float)_fp_step_cnt / (_fp_step_cnt + _unw_step_cnt) * 100
+            );
+        }
+
+        if (_stall_cnt) {
+            log_m(
+                STAT_INDENT "Average stall time" BLK " . . . . " CRESET BOLD "%.2f ms" CRESET " (max " BOLD "%.2f ms"
+                            CRESET ")",
+                _stall_time / 1000. / _stall_cnt, _max_stall_time / 1000.
+            );
+        }
+#endif
+
         log_m(
             STAT_INDENT "Error rate" BLK " . . . . . . . . " CRESET BOLD "%d/%d" CRESET " (" BOLD "%.2f%%" CRESET ")",
             _error_cnt, _sample_cnt, (float)_error_cnt / _sample_cnt * 100
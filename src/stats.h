@@ -39,6 +39,15 @@ extern ustat_t _error_cnt;
 extern ustat_t _long_cnt;
 
 extern microseconds_t _gc_time;
+
+#ifdef NATIVE
+extern ustat_t _fp_step_cnt;
+extern ustat_t _unw_step_cnt;
+
+extern ustat_t        _stall_cnt;
+extern microseconds_t _stall_time;
+extern microseconds_t _max_stall_time;
+#endif
 #endif
 
 /**
@@ -91,6 +100,32 @@ stats_get_avg_sampling_time();
 #define stats_gc_time(delta) \
     { _gc_time += (delta); }
 
+#ifdef NATIVE
+/**
+ * Count a native unwind step, either through the frame pointer (fast) or
+ * through libunwind.
+ */
+#define stats_count_native_step(fast) \
+    {                                 \
+        if (fast)                     \
+            _fp_step_cnt++;           \
+        else                          \
+            _unw_step_cnt++;          \
+    }
+
+/**
+ * Account for the time the threads of the tracee have been kept stopped for a
+ * sample.
+ */
+#define stats_stall_time(delta)        \
+    {                                  \
+        _stall_cnt++;                  \
+        _stall_time += (delta);        \
+        if (_max_stall_time < (delta)) \
+            _max_stall_time = (delta); \
+    }
+#endif
+
 /**
  * Check the duration of the last sampling and update the statistics.
  *
@@ -28,10 +28,13 @@
 
 #pragma once
 
+#include <ctype.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 
+#include "hints.h"
 #include "logging.h"
 #include "platform.h"
 #include "python/abi.h"
@@ -41,6 +44,58 @@
 #define MINOR(x)                       ((x >> 8) & 0xFF)
 #define PATCH(x)                       (x & 0xFF)
 
+// ----------------------------------------------------------------------------
+/**
+ * Look for the PY_VERSION string in the read-only data of a binary. The
+ * string might be the tail of a longer one, e.g. the installation prefix, so
+ * we only require that it is not preceded by a digit or a dot. Other strings
+ * might look like a version too, so we give up if we find candidates that do
+ * not agree with each other.
+ *
+ * @param data  the read-only data
+ * @param size  the size of the data
+ *
+ * @return the version, as given by PYVERSION, or 0 if none could be found.
+ */
+static inline int
+find_version_string(const char* data, size_t size) {
+    const char* end     = data + size;
+    const char* p       = data;
+    int         version = 0;
+
+    while (p < end && isvalid(p = memchr(p, '3', end - p))) {
+        const char* c = ++p;
+        if (c >= end || *c++ != '.')
+            continue;
+
+        if (p - 1 > data && (isdigit(p[-2]) || p[-2] == '.'))
+            continue;
+
+        int minor = 0, patch = 0;
+        if (c >= end || !isdigit(*c))
+            continue;
+        while (c < end && isdigit(*c) && minor <= 0xFF)
+            minor = minor * 10 + (*c++ - '0');
+        if (c >= end || *c++ != '.' || c >= end || !isdigit(*c))
+            continue;
+        while (c < end && isdigit(*c) && patch <= 0xFF)
+            patch = patch * 10 + (*c++ - '0');
+
+        // Allow for pre-release and local version suffixes, e.g. 3.14.0rc1+
+        while (c < end && (isalnum(*c) || *c == '+'))
+            c++;
+        if (c >= end || *c != '\0' || minor < 8 || minor > 0xFF || patch > 0xFF)
+            continue;
+
+        if (version && version != PYVERSION(3, minor, patch))
+            return 0;
+
+        version = PYVERSION(3, minor, patch);
+    }
+
+    return version;
+}
+
 /**
  * Get the value of a field of a versioned structure.
  *
@@ -133,8 +188,10 @@ typedef struct {
     offset_t o_interp;
     offset_t o_frame;
     offset_t o_thread_id;
+    offset_t o_id;
     offset_t o_native_thread_id;
     offset_t o_stack;
+    offset_t o_stack_top;
     offset_t o_status;
 } py_thread_v;
 
@@ -218,8 +275,11 @@ typedef struct {
         sizeof(s), offsetof(s, f_code), offsetof(s, previous), offsetof(s, prev_instr), 0, offsetof(s, owner), \
     }
 
-#define PY_THREAD(s)                                                                                                   \
-    {sizeof(s), offsetof(s, prev), offsetof(s, next), offsetof(s, interp), offsetof(s, frame), offsetof(s, thread_id)}
+#define PY_THREAD(s)                                                                              \
+    {                                                                                             \
+        sizeof(s), offsetof(s, prev), offsetof(s, next), offsetof(s, interp), offsetof(s, frame), \
+        offsetof(s, thread_id), offsetof(s, id),                                                  \
+    }
 
 #define PY_THREAD_311(s)               \
     {                                  \
@@ -229,8 +289,10 @@ typedef struct {
         offsetof(s, interp),           \
         offsetof(s, cframe),           \
         offsetof(s, thread_id),        \
+        offsetof(s, id),               \
         offsetof(s, native_thread_id), \
         offsetof(s, datastack_chunk),  \
+        offsetof(s, datastack_top),    \
     }
 
 #define PY_THREAD_312(s)            \
@@ -240,8 +302,10 @@ typedef struct {
      offsetof(s, interp),           \
      offsetof(s, cframe),           \
      offsetof(s, thread_id),        \
+     offsetof(s, id),               \
      offsetof(s, native_thread_id), \
      offsetof(s, datastack_chunk),  \
+     offsetof(s, datastack_top),    \
      offsetof(s, _status)}
 
 #define PY_RUNTIME(s)                   \
@@ -410,6 +474,9 @@ get_version_descriptor(int major, int minor, int patch) {
         V_ASSIGN(v, thread.o_native_thread_id, thread_state.native_thread_id); \
         V_ASSIGN(v, thread.o_stack, thread_state.datastack_chunk);             \
         V_ASSIGN(v, thread.o_status, thread_state.status);                     \
+        /* There is no debug offset for datastack_top, which follows */        \
+        /* datastack_chunk in the thread state structure. */                   \
+        py_v->py_thread.o_stack_top = py_v->py_thread.o_stack + sizeof(void*); \
     }
 
 #define PY_RUNTIME_313(v)                                                    \
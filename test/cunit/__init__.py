@@ -30,6 +30,8 @@ HERE = Path(__file__).resolve().parent
 TEST = HERE.parent
 ROOT = TEST.parent
 SRC = ROOT / "src"
+# Exported wrappers around the header-only modules of the sources.
+HARNESS = HERE / "harness"
 
 
 # ANSI color codes for print
@@ -433,3 +435,37 @@ class CModule(ModuleType):
     ):
         compile(source.with_suffix(".c"), cflags, extra_sources, ldadd)
         return cls(source)
+
+
+HARNESS_SOURCES = [
+    SRC / "argparse.c",
+    SRC / "cache.c",
+    SRC / "env.c",
+    SRC / "error.c",
+    SRC / "events.c",
+    SRC / "logging.c",
+    SRC / "stack.c",
+]
+
+
+def harness(module: str, cflags: list[str] = []) -> CModule:
+    # Header-only modules of the sources have no translation unit of their
+    # own, so they are compiled through a harness that exports wrappers around
+    # them. The test module that loads a harness shares its name.
+    return CModule.compile(
+        HARNESS / Path(module).stem,
+        cflags=["-g", "-fprofile-arcs", "-ftest-coverage", "-fPIC", f"-I{SRC}", *cflags],
+        extra_sources=HARNESS_SOURCES,
+    )
+
+
+def has_header(header: str) -> bool:
+    return (
+        run(
+            [CC, "-E", "-"],
+            stdout=PIPE,
+            stderr=PIPE,
+            input=f"#include <{header}>\n".encode(),
+        ).returncode
+        == 0
+    )
@@ -0,0 +1,77 @@
+// Test harness for the frame stack in src/stack.h.
+
+#include <time.h>
+
+#include "stack.h"
+
+#include "frame_stack.h"
+
+int
+allocate_stack(size_t size) {
+    return stack_allocate(size);
+}
+
+void
+deallocate_stack() {
+    stack_deallocate();
+}
+
+void
+reset_stack() {
+    stack_reset();
+}
+
+void
+push_frame(size_t origin) {
+    stack_py_push((raddr_t)origin, NULL, 0);
+}
+
+#ifdef NATIVE
+void
+push_cframe() {
+    stack_py_push_cframe();
+}
+#endif
+
+size_t
+stack_depth() {
+    return stack_pointer();
+}
+
+int
+stack_cycle() {
+    return stack_has_cycle();
+}
+
+unsigned int
+get_stack_generation() {
+    return _stack->generation;
+}
+
+void
+set_stack_generation(unsigned int generation) {
+    _stack->generation = generation;
+}
+
+double
+bench_stack(size_t depth, size_t samples) {
+    if (depth > _stack->size || depth == 0 || samples == 0)
+        return -1;
+
+    size_t          cycles = 0;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t s = 0; s < samples; s++) {
+        stack_reset();
+        // Frame objects are typically a few hundred bytes apart.
+        for (size_t i = 0; i < depth; i++)
+            stack_py_push((raddr_t)(0x7f0000000000 + i * 0x1a0), NULL, 0);
+        cycles += stack_has_cycle();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (cycles)
+        return -1;
+
+    return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / (depth * samples);
+}
@@ -0,0 +1,37 @@
+// Test harness for the frame stack in src/stack.h.
+
+#include <stddef.h>
+
+int
+allocate_stack(size_t size);
+
+void
+deallocate_stack();
+
+void
+reset_stack();
+
+// Push a Python frame with the given origin onto the stack.
+void
+push_frame(size_t origin);
+
+// Push a C frame marker onto the stack.
+void
+push_cframe();
+
+size_t
+stack_depth();
+
+int
+stack_cycle();
+
+unsigned int
+get_stack_generation();
+
+void
+set_stack_generation(unsigned int generation);
+
+// Time the given number of samples of a stack of the given depth, and return
+// the average time per push in nanoseconds.
+double
+bench_stack(size_t depth, size_t samples);
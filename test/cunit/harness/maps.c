@@ -0,0 +1,64 @@
+// Test harness for src/linux/proc/maps.h.
+
+#include "linux/proc/maps.h"
+
+#include "maps.h"
+
+maps_t*
+maps_new(int pid, char* text) {
+    if (!isvalid(text))
+        return proc_maps_new(pid);
+
+    proc_maps_t* self = (proc_maps_t*)calloc(1, sizeof(proc_maps_t));
+
+    self->fd     = -1;
+    self->size   = strlen(text);
+    self->buffer = strdup(text);
+
+    if (fail(_proc_maps__parse(self))) {
+        proc_maps__destroy(self);
+        return NULL;
+    }
+
+    return self;
+}
+
+int
+maps__refresh(maps_t* self) {
+    return proc_maps__refresh(self);
+}
+
+unsigned int
+maps__generation(maps_t* self) {
+    return self->generation;
+}
+
+size_t
+maps__count(maps_t* self) {
+    return self->count;
+}
+
+size_t
+maps__address(maps_t* self, size_t i) {
+    return (size_t)self->maps[i].address;
+}
+
+size_t
+maps__size(maps_t* self, size_t i) {
+    return self->maps[i].size;
+}
+
+int
+maps__perms(maps_t* self, size_t i) {
+    return self->maps[i].perms;
+}
+
+char*
+maps__pathname(maps_t* self, size_t i) {
+    return self->maps[i].pathname;
+}
+
+void
+maps__destroy(maps_t* self) {
+    proc_maps__destroy(self);
+}
@@ -0,0 +1,34 @@
+// Test harness for src/linux/proc/maps.h.
+
+#include <stddef.h>
+
+typedef struct _proc_maps maps_t;
+
+// Parse the given maps content if text is not NULL, otherwise read the maps of
+// the process with the given pid.
+maps_t*
+maps_new(int pid, char* text);
+
+int
+maps__refresh(maps_t* self);
+
+unsigned int
+maps__generation(maps_t* self);
+
+size_t
+maps__count(maps_t* self);
+
+size_t
+maps__address(maps_t* self, size_t i);
+
+size_t
+maps__size(maps_t* self, size_t i);
+
+int
+maps__perms(maps_t* self, size_t i);
+
+char*
+maps__pathname(maps_t* self, size_t i);
+
+void
+maps__destroy(maps_t* self);
@@ -0,0 +1,15 @@
+// Test harness for src/linux/proc/statm.h.
+
+#include "linux/proc/statm.h"
+
+#include "statm.h"
+
+long
+statm_parse_resident(char* text) {
+    return proc_statm_parse_resident(text);
+}
+
+long
+statm_read_resident(int fd) {
+    return proc_statm_read_resident(fd);
+}
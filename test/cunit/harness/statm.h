@@ -0,0 +1,11 @@
+// Test harness for src/linux/proc/statm.h.
+
+#include <stddef.h>
+
+// Parse the number of resident pages from the given statm content.
+long
+statm_parse_resident(char* text);
+
+// Read the number of resident pages from the given open statm file.
+long
+statm_read_resident(int fd);
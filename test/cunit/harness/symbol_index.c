@@ -0,0 +1,74 @@
+// Test harness for src/linux/symbol-index.h.
+
+#include <string.h>
+#include <unistd.h>
+
+#include "linux/symbol-index.h"
+
+#include "symbol_index.h"
+
+// A function symbol without a size, like those of hand-written assembly.
+__asm__(".globl unsized_function\n"
+        ".type unsized_function, @function\n"
+        "unsized_function:\n"
+        "ret\n"
+        ".skip 15\n");
+
+symbols_t*
+symbols_new(char* path) {
+    return symbol_index__get(getpid(), path);
+}
+
+size_t
+symbols__count(symbols_t* self) {
+    return self->count;
+}
+
+size_t
+symbols__load_address(symbols_t* self) {
+    return self->load_address;
+}
+
+size_t
+symbols__start(symbols_t* self, size_t i) {
+    return self->symbols[i].start;
+}
+
+size_t
+symbols__size(symbols_t* self, size_t i) {
+    return self->symbols[i].size;
+}
+
+char*
+symbols__name(symbols_t* self, size_t i) {
+    return symbol_index__name(self, self->symbols + i);
+}
+
+char*
+symbols__find(symbols_t* self, size_t addr) {
+    symbol_t* symbol = symbol_index__find(self, addr);
+
+    return isvalid(symbol) ? symbol_index__name(self, symbol) : NULL;
+}
+
+void
+symbols__destroy(symbols_t* self) {}
+
+void*
+get_symbol_index(char* path) {
+    return symbol_index__get(getpid(), path);
+}
+
+long
+elf_section_name_length(char* path, size_t i) {
+    cu_elf_file_t* elf = elf_file_open(path);
+    if (!isvalid(elf) || i >= elf->n_sections)
+        return -1;
+
+    return strlen(elf->sections[i].name);
+}
+
+void
+destroy_symbol_indices(void) {
+    symbol_indices__destroy();
+}
@@ -0,0 +1,43 @@
+// Test harness for src/linux/symbol-index.h.
+
+#include <stddef.h>
+
+typedef struct _symbol_index symbols_t;
+
+// Get the symbol index of the binary at the given path, as mapped by the
+// current process. The index is owned by the registry of symbol indices.
+symbols_t*
+symbols_new(char* path);
+
+size_t
+symbols__count(symbols_t* self);
+
+size_t
+symbols__load_address(symbols_t* self);
+
+size_t
+symbols__start(symbols_t* self, size_t i);
+
+size_t
+symbols__size(symbols_t* self, size_t i);
+
+char*
+symbols__name(symbols_t* self, size_t i);
+
+// Get the name of the symbol that contains the given address, if any.
+char*
+symbols__find(symbols_t* self, size_t addr);
+
+void
+symbols__destroy(symbols_t* self);
+
+void*
+get_symbol_index(char* path);
+
+// Get the length of the name of the i-th section of the ELF file at the given
+// path, or -1 if the file cannot be opened.
+long
+elf_section_name_length(char* path, size_t i);
+
+void
+destroy_symbol_indices();
@@ -0,0 +1,10 @@
+// Test harness for the version string scanner in src/version.h.
+
+#include "version.h"
+
+#include "version_string.h"
+
+int
+version_from_data(char* data, size_t size) {
+    return find_version_string(data, size);
+}
@@ -0,0 +1,8 @@
+// Test harness for the version string scanner in src/version.h.
+
+#include <stddef.h>
+
+// Find the Python version string in the given read-only data and return it as
+// a hex version, or 0 if it cannot be determined.
+int
+version_from_data(char* data, size_t size);
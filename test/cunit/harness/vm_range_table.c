@@ -0,0 +1,101 @@
+// Test harness for src/linux/vm-range-table.h.
+
+#include <string.h>
+#include <time.h>
+
+#include "linux/vm-range-table.h"
+
+#include "vm_range_table.h"
+
+ranges_t*
+ranges_new() {
+    return vm_range_table_new();
+}
+
+long
+ranges__add(ranges_t* self, size_t lo, size_t hi, char* name) {
+    vm_range_t* range = vm_range_table__add(self, lo, hi, lo, strdup(name));
+    return isvalid(range) ? range - self->ranges : -1;
+}
+
+size_t
+ranges__count(ranges_t* self) {
+    return self->count;
+}
+
+size_t
+ranges__lo(ranges_t* self, size_t i) {
+    return self->ranges[i].lo;
+}
+
+size_t
+ranges__hi(ranges_t* self, size_t i) {
+    return self->ranges[i].hi;
+}
+
+char*
+ranges__name(ranges_t* self, size_t i) {
+    return self->ranges[i].name;
+}
+
+long
+ranges__find(ranges_t* self, size_t addr) {
+    vm_range_t* range = vm_range_table__find(self, addr);
+    return isvalid(range) ? range - self->ranges : -1;
+}
+
+void
+ranges__clear(ranges_t* self) {
+    vm_range_table__clear(self);
+}
+
+static vm_range_t*
+_ranges__find_linear(ranges_t* self, addr_t addr) {
+    for (size_t i = 0; i < self->count; i++)
+        if (self->ranges[i].lo <= addr && addr < self->ranges[i].hi)
+            return self->ranges + i;
+
+    return NULL;
+}
+
+double
+ranges__bench(ranges_t* self, size_t lookups, int linear) {
+    if (self->count == 0 || lookups == 0)
+        return 0;
+
+    addr_t lo   = self->ranges[0].lo;
+    addr_t span = self->ranges[self->count - 1].hi - lo;
+
+    addr_t* addrs = (addr_t*)malloc(lookups * sizeof(addr_t));
+    if (!isvalid(addrs))
+        return -1;
+
+    // Use a fixed xorshift sequence so that every run looks up the same
+    // addresses.
+    uint64_t x = 0x9E3779B97F4A7C15ULL;
+    for (size_t i = 0; i < lookups; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        addrs[i] = lo + x % span;
+    }
+
+    size_t          found = 0;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < lookups; i++)
+        found += isvalid(linear ? _ranges__find_linear(self, addrs[i]) : vm_range_table__find(self, addrs[i]));
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    free(addrs);
+
+    if (found == 0)
+        return -1;
+
+    return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / lookups;
+}
+
+void
+ranges__destroy(ranges_t* self) {
+    vm_range_table__destroy(self);
+}
@@ -0,0 +1,40 @@
+// Test harness for src/linux/vm-range-table.h.
+
+#include <stddef.h>
+
+typedef struct _vm_range_table ranges_t;
+
+ranges_t*
+ranges_new();
+
+// Add the range [lo, hi) and return its index in the table, or -1 on failure.
+long
+ranges__add(ranges_t* self, size_t lo, size_t hi, char* name);
+
+size_t
+ranges__count(ranges_t* self);
+
+size_t
+ranges__lo(ranges_t* self, size_t i);
+
+size_t
+ranges__hi(ranges_t* self, size_t i);
+
+char*
+ranges__name(ranges_t* self, size_t i);
+
+// Get the index of the range that contains the given address, or -1.
+long
+ranges__find(ranges_t* self, size_t addr);
+
+void
+ranges__clear(ranges_t* self);
+
+// Time the given number of look-ups of random addresses within the table, and
+// return the average time per look-up in nanoseconds. If linear is not zero,
+// a linear scan of the table is timed instead, for reference.
+double
+ranges__bench(ranges_t* self, size_t lookups, int linear);
+
+void
+ranges__destroy(ranges_t* self);
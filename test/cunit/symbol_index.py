@@ -0,0 +1,5 @@
+import sys
+from test.cunit import harness
+
+
+sys.modules[__name__] = harness(__file__, cflags=["-DAUSTINP"])
@@ -0,0 +1,103 @@
+import sys
+
+import pytest
+
+
+pytestmark = pytest.mark.skipif(
+    sys.platform != "linux", reason="Only applicable on Linux"
+)
+
+
+@pytest.fixture
+def stack():
+    from test.cunit import frame_stack
+
+    assert frame_stack.allocate_stack(64) == 0
+    frame_stack.reset_stack()
+    yield frame_stack
+    frame_stack.deallocate_stack()
+
+
+def test_stack_no_cycle(stack):
+    for origin in range(0x1000, 0x1000 + 64 * 0x10, 0x10):
+        stack.push_frame(origin)
+
+    assert stack.stack_depth() == 64
+    assert not stack.stack_cycle()
+
+
+def test_stack_cycle(stack):
+    stack.push_frame(0x1000)
+    stack.push_frame(0x2000)
+    assert not stack.stack_cycle()
+
+    stack.push_frame(0x1000)
+    assert stack.stack_cycle()
+
+
+def test_stack_reset_forgets_origins(stack):
+    stack.push_frame(0x1000)
+    stack.push_frame(0x1000)
+    assert stack.stack_cycle()
+
+    # The same origins can be pushed again on the next sample.
+    stack.reset_stack()
+    assert not stack.stack_cycle()
+    assert stack.stack_depth() == 0
+
+    stack.push_frame(0x1000)
+    assert not stack.stack_cycle()
+
+
+def test_stack_generation_wraparound(stack):
+    # Leave an origin behind with the first generation.
+    stack.set_stack_generation(1)
+    stack.push_frame(0x1000)
+
+    # When the generation wraps around, the stale slots must be cleared, or
+    # they would be mistaken for origins of the current stack.
+    stack.set_stack_generation(0xFFFFFFFF)
+    stack.reset_stack()
+    assert stack.get_stack_generation() == 1
+
+    stack.push_frame(0x1000)
+    assert not stack.stack_cycle()
+
+    stack.push_frame(0x1000)
+    assert stack.stack_cycle()
+
+
+def test_stack_cframe_not_a_cycle(stack):
+    # C frame markers share the same origin, but they do not form a cycle.
+    if not hasattr(stack, "push_cframe"):
+        pytest.skip("C frame markers are only used by austinp")
+
+    stack.push_frame(0x1000)
+    stack.push_cframe()
+    stack.push_frame(0x2000)
+    stack.push_cframe()
+
+    assert stack.stack_depth() == 4
+    assert not stack.stack_cycle()
+
+
+def test_stack_bench():
+    # Microbenchmark of the stack pushes, including cycle detection. Run with
+    # -s to see the timings.
+    from test.cunit import frame_stack
+
+    assert frame_stack.allocate_stack(4096) == 0
+    try:
+        print()
+        print(f"{'depth':>8} {'push':>12}")
+        timings = {}
+        for depth in (16, 256, 4096):
+            timings[depth] = frame_stack.bench_stack(depth, (1 << 20) // depth)
+            assert timings[depth] > 0
+            print(f"{depth:>8} {timings[depth]:>9.1f} ns")
+    finally:
+        frame_stack.deallocate_stack()
+
+    # The cost of a push does not depend on the depth of the stack. A linear
+    # scan for cycles would be hundreds of times slower on the deepest stack.
+    assert timings[4096] < timings[16] * 20
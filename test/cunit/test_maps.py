@@ -0,0 +1,80 @@
+import sys
+from pathlib import Path
+from subprocess import Popen
+from time import sleep
+
+import pytest
+
+
+pytestmark = pytest.mark.skipif(
+    sys.platform != "linux", reason="Only applicable on Linux"
+)
+
+
+MAPS = b"""\
+55d0a000-55d0b000 r--p 00000000 08:01 1234                       /usr/bin/python3.12
+55d0b000-55d0c000 r-xp 00001000 08:01 1234                       /usr/bin/python3.12
+55d0c000-55d0d000 rw-p 00002000 08:01 1234                       /usr/bin/python3.12
+55d0e000-55d2f000 rw-p 00000000 00:00 0                          [heap]
+7f0000000000-7f0000021000 rw-p 00000000 00:00 0 
+7f1000000000-7f1000001000 r--p 00000000 08:01 5678               /opt/with space/libpython3.12.so
+7ffc00000000-7ffc00021000 rw-p 00000000 00:00 0                  [stack]
+"""
+
+
+def test_maps_parse():
+    from test.cunit.maps import Maps
+
+    maps = Maps(0, MAPS)
+
+    assert maps.count() == 7
+
+    assert maps.address(0) == 0x55D0A000
+    assert maps.size(0) == 0x1000
+    assert maps.pathname(0) == b"/usr/bin/python3.12"
+
+    # PERMS_READ | PERMS_EXEC
+    assert maps.perms(1) == 5
+    # PERMS_READ | PERMS_WRITE
+    assert maps.perms(2) == 3
+
+    assert maps.pathname(3) == b"[heap]"
+    assert maps.pathname(4) is None
+    assert maps.pathname(5) == b"/opt/with space/libpython3.12.so"
+
+    assert maps.address(6) == 0x7FFC00000000
+    assert maps.size(6) == 0x21000
+    assert maps.pathname(6) == b"[stack]"
+
+
+def test_maps_parse_no_trailing_newline():
+    from test.cunit.maps import Maps
+
+    maps = Maps(0, MAPS.rstrip(b"\n"))
+
+    assert maps.count() == 7
+    assert maps.pathname(6) == b"[stack]"
+
+
+def test_maps_refresh_unchanged():
+    from test.cunit.maps import Maps
+
+    # A sleeping process does not change its memory maps, but we need to wait
+    # for the dynamic loader to be done with it first.
+    p = Popen(["sleep", "10"])
+    try:
+        stat = Path("/proc") / str(p.pid) / "stat"
+        while stat.read_text().rpartition(")")[2].split()[0] != "S":
+            sleep(0.01)
+        sleep(0.1)
+
+        maps = Maps(p.pid, None)
+        generation = maps.generation()
+        assert maps.count() > 0
+
+        for _ in range(2):
+            assert maps.refresh() == 0
+            assert maps.generation() == generation
+    finally:
+        p.kill()
+        p.wait()
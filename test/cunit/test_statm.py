@@ -0,0 +1,39 @@
+import os
+import sys
+
+import pytest
+
+
+pytestmark = pytest.mark.skipif(
+    sys.platform != "linux", reason="Only applicable on Linux"
+)
+
+
+def test_statm_parse_resident():
+    from test.cunit.statm import statm_parse_resident
+
+    assert statm_parse_resident(b"6036 1527 1036 1 0 187 0\n") == 1527
+    assert statm_parse_resident(b"4294967296 4294967295 0 0 0 0 0\n") == 4294967295
+    assert statm_parse_resident(b"0 0 0 0 0 0 0\n") == 0
+
+
+def test_statm_parse_resident_invalid():
+    from test.cunit.statm import statm_parse_resident
+
+    assert statm_parse_resident(b"") == -1
+    assert statm_parse_resident(b"6036") == -1
+    assert statm_parse_resident(b"6036 ") == -1
+    assert statm_parse_resident(b" 1527 1036\n") == -1
+    assert statm_parse_resident(b"6036\t1527\n") == -1
+
+
+def test_statm_read_resident():
+    from test.cunit.statm import statm_read_resident
+
+    fd = os.open("/proc/self/statm", os.O_RDONLY)
+    try:
+        # The same descriptor can be read multiple times.
+        for _ in range(2):
+            assert statm_read_resident(fd) > 0
+    finally:
+        os.close(fd)
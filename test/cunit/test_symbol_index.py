@@ -0,0 +1,161 @@
+import shutil
+import struct
+import sys
+from test.cunit import HARNESS
+from test.cunit import has_header
+
+import pytest
+
+
+pytestmark = [
+    pytest.mark.skipif(sys.platform != "linux", reason="Only applicable on Linux"),
+    # The symbol index is only part of austinp.
+    pytest.mark.skipif(
+        not has_header("libunwind-ptrace.h"), reason="Requires libunwind"
+    ),
+]
+
+
+# The harness binary is not stripped, so it makes for a good test subject.
+BINARY = str(HARNESS / "symbol_index.so")
+
+
+def test_symbol_index_build():
+    from test.cunit.symbol_index import Symbols
+
+    index = Symbols(BINARY.encode())
+
+    n = index.count()
+    assert n > 0
+
+    names = [index.name(i) for i in range(n)]
+    assert b"symbols__find" in names
+    assert b"get_symbol_index" in names
+
+    starts = [index.start(i) for i in range(n)]
+    assert starts == sorted(set(starts))
+
+
+def test_symbol_index_find():
+    from test.cunit.symbol_index import Symbols
+
+    index = Symbols(BINARY.encode())
+
+    n = index.count()
+    for i in range(n):
+        start, size, name = index.start(i), index.size(i), index.name(i)
+
+        assert index.find(start) == name
+        if size > 0:
+            assert index.find(start + size - 1) == name
+            if i + 1 == n or index.start(i + 1) > start + size:
+                assert index.find(start + size) is None
+        elif i + 1 == n or index.start(i + 1) > start + 1:
+            assert index.find(start + 1) is None
+
+    assert index.find(index.start(0) - 1) is None
+
+    (unsized,) = [i for i in range(n) if index.name(i) == b"unsized_function"]
+    assert index.size(unsized) == 0
+    assert index.find(index.start(unsized)) == b"unsized_function"
+    assert index.find(index.start(unsized) + 1) is None
+
+
+def test_symbol_index_shared(tmp_path):
+    from test.cunit.symbol_index import get_symbol_index
+
+    index = get_symbol_index(BINARY.encode())
+    assert index
+    assert get_symbol_index(BINARY.encode()) == index
+
+    # A copy of the same binary has the same build ID.
+    copy = tmp_path / "copy.so"
+    shutil.copy(BINARY, copy)
+    assert get_symbol_index(str(copy).encode()) == index
+
+    link = tmp_path / "link.so"
+    link.symlink_to(BINARY)
+    assert get_symbol_index(str(link).encode()) == index
+
+
+def test_symbol_index_missing(tmp_path):
+    from test.cunit.symbol_index import Symbols
+    from test.cunit.symbol_index import get_symbol_index
+
+    missing = str(tmp_path / "missing.so").encode()
+
+    index = get_symbol_index(missing)
+    assert index
+    assert Symbols(missing).count() == 0
+
+    # Failed loads are remembered, even if the file appears later on.
+    shutil.copy(BINARY, tmp_path / "missing.so")
+    assert get_symbol_index(missing) == index
+
+
+def _elf(strtab_offset, strtab_size, size):
+    # A minimal 64-bit ELF file with a null section and a section name table.
+    ehdr = struct.pack(
+        "<16sHHIQQQIHHHHHH",
+        b"\x7fELF\x02\x01\x01",
+        3,  # ET_DYN
+        62,  # EM_X86_64
+        1,
+        0,
+        0,
+        64,  # e_shoff
+        0,
+        64,
+        56,
+        0,
+        64,  # e_shentsize
+        2,  # e_shnum
+        1,  # e_shstrndx
+    )
+    null = bytes(64)
+    strtab = struct.pack(
+        "<IIQQQQIIQQ", 1, 3, 0, 0, strtab_offset, strtab_size, 0, 0, 1, 0
+    )
+    header = ehdr + null + strtab
+    return header + b"A" * (size - len(header))
+
+
+def test_symbol_index_unterminated_section_names(tmp_path):
+    from test.cunit.symbol_index import Symbols
+    from test.cunit.symbol_index import elf_section_name_length
+
+    # The section name table runs up to the end of a page-aligned file
+    # without a NUL terminator.
+    binary = tmp_path / "unterminated.so"
+    binary.write_bytes(_elf(192, 4096 - 192, 4096))
+
+    assert elf_section_name_length(str(binary).encode(), 1) == 0
+    assert Symbols(str(binary).encode()).count() == 0
+
+
+def test_symbol_index_truncated_section_names(tmp_path):
+    from test.cunit.symbol_index import Symbols
+    from test.cunit.symbol_index import elf_section_name_length
+
+    # The section name table extends past the end of the file.
+    binary = tmp_path / "truncated.so"
+    binary.write_bytes(_elf(192, 1 << 20, 4096))
+
+    assert elf_section_name_length(str(binary).encode(), 1) == -1
+    assert Symbols(str(binary).encode()).count() == 0
+
+    binary = tmp_path / "overflow.so"
+    binary.write_bytes(_elf(1 << 63, 1 << 63, 4096))
+
+    assert elf_section_name_length(str(binary).encode(), 1) == -1
+    assert Symbols(str(binary).encode()).count() == 0
+
+
+def test_symbol_index_destroy():
+    from test.cunit.symbol_index import destroy_symbol_indices
+    from test.cunit.symbol_index import get_symbol_index
+
+    assert get_symbol_index(BINARY.encode())
+    destroy_symbol_indices()
+    assert get_symbol_index(BINARY.encode())
+    destroy_symbol_indices()
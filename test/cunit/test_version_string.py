@@ -0,0 +1,50 @@
+def hexversion(minor, patch):
+    return (3 << 16) | (minor << 8) | patch
+
+
+def find(data):
+    from test.cunit.version_string import version_from_data
+
+    return version_from_data(data, len(data))
+
+
+def test_version_string_plain():
+    data = b"\0%.80s (%.80s) %.80s\0" + b"3.11.7\0more data\0"
+    assert find(data) == hexversion(11, 7)
+
+
+def test_version_string_prefix_tail():
+    # The version string can be tail-merged with the installation prefix
+    assert find(b"\0/opt/python/3.10.13\0") == hexversion(10, 13)
+
+
+def test_version_string_suffix():
+    assert find(b"\x003.14.0rc1\0") == hexversion(14, 0)
+    assert find(b"\x003.12.1+\0") == hexversion(12, 1)
+
+
+def test_version_string_rejected():
+    # Too old to be a supported Python version (e.g. the unidata version)
+    assert find(b"\x003.2.0\0") == 0
+
+    # Part of a longer version string
+    assert find(b"\x0013.11.7\0") == 0
+    assert find(b"\x001.3.11.7\0") == 0
+
+    # Not NUL-terminated
+    assert find(b"\x003.11.7") == 0
+    assert find(b"\x003.11.7 final\0") == 0
+
+    # Not a version
+    assert find(b"\x003.\0") == 0
+    assert find(b"\x003.11\0") == 0
+    assert find(b"") == 0
+
+
+def test_version_string_repeated():
+    assert find(b"\x003.11.7\0/usr/lib/3.11.7\0") == hexversion(11, 7)
+    assert find(b"\x003.2.0\x003.11.7\0") == hexversion(11, 7)
+
+
+def test_version_string_ambiguous():
+    assert find(b"\x003.11.7\x003.12.0\0") == 0
@@ -0,0 +1,110 @@
+import sys
+
+import pytest
+
+
+pytestmark = pytest.mark.skipif(
+    sys.platform != "linux", reason="Only applicable on Linux"
+)
+
+
+def make_table(n, gap=0x1000, size=0x3000, base=0x10000):
+    from test.cunit.vm_range_table import Ranges
+
+    table = Ranges()
+    for i in range(n):
+        lo = base + i * (size + gap)
+        assert table.add(lo, lo + size, f"range{i}".encode()) == i
+
+    return table
+
+
+def test_vm_range_table_empty():
+    from test.cunit.vm_range_table import Ranges
+
+    table = Ranges()
+
+    assert table.count() == 0
+    assert table.find(0) == -1
+    assert table.find(0x10000) == -1
+
+
+def test_vm_range_table_add_out_of_order():
+    from test.cunit.vm_range_table import Ranges
+
+    table = Ranges()
+
+    assert table.add(0x5000, 0x6000, b"c") == 0
+    assert table.add(0x1000, 0x2000, b"a") == 0
+    assert table.add(0x9000, 0xA000, b"d") == 2
+    assert table.add(0x3000, 0x4000, b"b") == 1
+
+    assert table.count() == 4
+    assert [table.lo(i) for i in range(4)] == [0x1000, 0x3000, 0x5000, 0x9000]
+    assert [table.hi(i) for i in range(4)] == [0x2000, 0x4000, 0x6000, 0xA000]
+    assert [table.name(i) for i in range(4)] == [b"a", b"b", b"c", b"d"]
+
+    assert table.find(0x3800) == 1
+    assert table.find(0x9FFF) == 3
+
+
+@pytest.mark.parametrize("n", [1, 2, 3, 7, 8, 9, 63, 64, 65, 100])
+def test_vm_range_table_find(n):
+    # The branchless search halves the table on every step, so we check sizes
+    # around powers of two, as well as the boundaries of every range.
+    table = make_table(n)
+
+    assert table.count() == n
+
+    for i in range(n):
+        lo, hi = table.lo(i), table.hi(i)
+        assert table.find(lo) == i
+        assert table.find(lo + 1) == i
+        assert table.find(hi - 1) == i
+        assert table.find(hi) == -1  # In the gap to the next range
+        assert table.find(lo - 1) == -1
+
+    assert table.find(0) == -1
+    assert table.find(table.hi(n - 1) + 0x10000) == -1
+
+
+def test_vm_range_table_find_adjacent():
+    table = make_table(100, gap=0)
+
+    for i in range(100):
+        assert table.find(table.lo(i)) == i
+        assert table.find(table.hi(i) - 1) == i
+
+    assert table.find(table.hi(99)) == -1
+
+
+def test_vm_range_table_clear():
+    table = make_table(100)
+
+    table.clear()
+    assert table.count() == 0
+    assert table.find(0x10000) == -1
+
+    # The table can be refilled after being cleared.
+    assert table.add(0x1000, 0x2000, b"a") == 0
+    assert table.count() == 1
+    assert table.find(0x1800) == 0
+
+
+def test_vm_range_table_bench():
+    # Microbenchmark of the look-ups, with a linear scan as a reference. Run
+    # with -s to see the timings.
+    print()
+    print(f"{'ranges':>8} {'table':>12} {'linear':>12}")
+    for n in (64, 256, 1024, 4096):
+        table = make_table(n)
+
+        lookups = 1 << 20
+        binary = table.bench(lookups, 0)
+        linear = table.bench(lookups >> 4, 1)
+        assert binary > 0 and linear > 0
+
+        print(f"{n:>8} {binary:>9.1f} ns {linear:>9.1f} ns")
+
+    # With this many ranges a linear scan is an order of magnitude slower.
+    assert binary < linear